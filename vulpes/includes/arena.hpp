@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Contiguous, arena-owned array. Does not own or destroy its elements.
+template <typename T>
+struct Span {
+    T* data = nullptr;
+    size_t count = 0;
+
+    T* begin() const { return data; }
+    T* end() const { return data + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t index) const { return data[index]; }
+};
+
+// Bump allocator. Memory is released all at once when the arena dies, one
+// free per chunk; objects placed in it never have their destructors run.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    Span<T> copy(const std::vector<T>& items) {
+        static_assert(std::is_trivially_copyable<T>::value, "arena spans hold trivially copyable items");
+        if (items.empty()) return {};
+        T* data = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+        std::uninitialized_copy(items.begin(), items.end(), data);
+        return {data, items.size()};
+    }
+
+    std::string_view copy(std::string_view text);
+
+    // Takes over other's chunks so everything allocated there lives as long
+    // as this arena; other is left empty.
+    void adopt(Arena&& other);
+
+    size_t bytesAllocated() const { return used; }
+
+private:
+    // Chunks start small and double up to ChunkSize, so an arena holding a
+    // single small tree doesn't cost a full chunk.
+    static constexpr size_t FirstChunkSize = 1024;
+    static constexpr size_t ChunkSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t nextChunkSize = FirstChunkSize;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t used = 0;
+};
@@ -1,152 +1,342 @@
 #pragma once
-#include <memory>
-#include <string>
+#include "arena.hpp"
+#include "symbol.hpp"
+#include <cassert>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
+// All nodes are placed in an ASTContext arena and released with it; no
+// node destructor ever runs, so nodes only hold trivially destructible
+// members: child pointers, arena spans, Symbols and views into interned or
+// arena-owned text.
+
 struct Parameter {
-    std::string type;
-    std::string name;
+    std::string_view type;
+    Symbol name;
+};
+
+// Concrete node type, stored in every node so passes can dispatch with a
+// switch instead of RTTI. Expressions come first, then statements.
+enum class NodeKind : std::uint8_t {
+    Number,
+    Float,
+    String,
+    Bool,
+    Variable,
+    Unary,
+    Binary,
+    Assignment,
+    Call,
+    Block,
+    VariableDeclaration,
+    AssignmentStatement,
+    ExpressionStatement,
+    Return,
+    If,
+    For,
+    While,
+    Print,
+    Gather,
+    FunctionDefinition,
+    ModuleImport,
 };
 
 // Base nodes
 struct ASTNode {
-    virtual ~ASTNode() = default;
+    NodeKind kind;
+protected:
+    explicit ASTNode(NodeKind k) : kind(k) {}
 };
 
 struct Expression : ASTNode {
-    virtual ~Expression() = default;
+    static bool classof(NodeKind k) { return k <= NodeKind::Call; }
+protected:
+    using ASTNode::ASTNode;
 };
 
 struct Statement : ASTNode {
-    virtual ~Statement() = default;
+    static bool classof(NodeKind k) { return k >= NodeKind::Block; }
+protected:
+    using ASTNode::ASTNode;
 };
 
 // Expressions
 struct NumberExpression : Expression {
+    static constexpr NodeKind Kind = NodeKind::Number;
     int value;
-    explicit NumberExpression(int v) : value(v) {}
+    explicit NumberExpression(int v) : Expression(Kind), value(v) {}
 };
 
 struct FloatExpression : Expression {
+    static constexpr NodeKind Kind = NodeKind::Float;
     double value;
-    explicit FloatExpression(double v) : value(v) {}
+    explicit FloatExpression(double v) : Expression(Kind), value(v) {}
 };
 
 struct StringExpression : Expression {
-    std::string value;
-    explicit StringExpression(std::string v) : value(std::move(v)) {}
+    static constexpr NodeKind Kind = NodeKind::String;
+    std::string_view value;
+    explicit StringExpression(std::string_view v) : Expression(Kind), value(v) {}
 };
 
 struct BoolExpression : Expression {
+    static constexpr NodeKind Kind = NodeKind::Bool;
     bool value;
-    explicit BoolExpression(bool v) : value(v) {}
+    explicit BoolExpression(bool v) : Expression(Kind), value(v) {}
 };
 
 struct VariableExpression : Expression {
-    std::string name;
-    explicit VariableExpression(std::string n) : name(std::move(n)) {}
+    static constexpr NodeKind Kind = NodeKind::Variable;
+    Symbol name;
+    explicit VariableExpression(Symbol n) : Expression(Kind), name(n) {}
+};
+
+enum class UnaryOp : std::uint8_t { Negate };
+
+// Comparisons come first so isComparison() is a single range check.
+enum class BinaryOp : std::uint8_t {
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Add,
+    Subtract,
+    Multiply,
+    Divide
 };
 
+inline bool isComparison(BinaryOp op) {
+    return op <= BinaryOp::GreaterEqual;
+}
+
 struct UnaryExpression : Expression {
-    std::string op;
-    std::unique_ptr<Expression> operand;
-    UnaryExpression(std::string o, std::unique_ptr<Expression> expr)
-        : op(std::move(o)), operand(std::move(expr)) {}
+    static constexpr NodeKind Kind = NodeKind::Unary;
+    UnaryOp op;
+    Expression* operand;
+    UnaryExpression(UnaryOp o, Expression* expr)
+        : Expression(Kind), op(o), operand(expr) {}
 };
 
 struct BinaryExpression : Expression {
-    std::string op;
-    std::unique_ptr<Expression> left;
-    std::unique_ptr<Expression> right;
-    BinaryExpression(std::unique_ptr<Expression> l, std::string o, std::unique_ptr<Expression> r)
-        : op(std::move(o)), left(std::move(l)), right(std::move(r)) {}
+    static constexpr NodeKind Kind = NodeKind::Binary;
+    BinaryOp op;
+    Expression* left;
+    Expression* right;
+    BinaryExpression(Expression* l, BinaryOp o, Expression* r)
+        : Expression(Kind), op(o), left(l), right(r) {}
 };
 
 struct AssignmentExpression : Expression {
-    std::string name;
-    std::unique_ptr<Expression> value;
-    AssignmentExpression(std::string n, std::unique_ptr<Expression> v)
-        : name(std::move(n)), value(std::move(v)) {}
+    static constexpr NodeKind Kind = NodeKind::Assignment;
+    Symbol name;
+    Expression* value;
+    AssignmentExpression(Symbol n, Expression* v)
+        : Expression(Kind), name(n), value(v) {}
 };
 
 struct CallExpression : Expression {
-    std::string name;
-    std::string ns;
-    std::vector<std::unique_ptr<Expression>> arguments;
-    CallExpression(std::string n, std::vector<std::unique_ptr<Expression>> args, std::string nsName = "")
-        : name(std::move(n)), ns(std::move(nsName)), arguments(std::move(args)) {}
+    static constexpr NodeKind Kind = NodeKind::Call;
+    Symbol name;
+    Symbol ns;
+    Span<Expression*> arguments;
+    CallExpression(Symbol n, Span<Expression*> args, Symbol nsName = NoSymbol)
+        : Expression(Kind), name(n), ns(nsName), arguments(args) {}
 };
 
 // Statements
 struct BlockStatement : Statement {
-    std::vector<std::unique_ptr<Statement>> statements;
+    static constexpr NodeKind Kind = NodeKind::Block;
+    Span<Statement*> statements;
+    BlockStatement() : Statement(Kind) {}
 };
 
 struct VariableDeclaration : Statement {
-    std::string name;
-    std::string type;
+    static constexpr NodeKind Kind = NodeKind::VariableDeclaration;
+    Symbol name;
+    std::string_view type;
     bool isConst;
-    std::unique_ptr<Expression> initializer;
-    VariableDeclaration(std::string n, std::string t, bool c, std::unique_ptr<Expression> init)
-        : name(std::move(n)), type(std::move(t)), isConst(c), initializer(std::move(init)) {}
+    Expression* initializer;
+    VariableDeclaration(Symbol n, std::string_view t, bool c, Expression* init)
+        : Statement(Kind), name(n), type(t), isConst(c), initializer(init) {}
 };
 
 struct AssignmentStatement : Statement {
-    std::string name;
-    std::unique_ptr<Expression> value;
-    AssignmentStatement(std::string n, std::unique_ptr<Expression> v)
-        : name(std::move(n)), value(std::move(v)) {}
+    static constexpr NodeKind Kind = NodeKind::AssignmentStatement;
+    Symbol name;
+    Expression* value;
+    AssignmentStatement(Symbol n, Expression* v)
+        : Statement(Kind), name(n), value(v) {}
 };
 
 struct ExpressionStatement : Statement {
-    std::unique_ptr<Expression> expression;
-    explicit ExpressionStatement(std::unique_ptr<Expression> expr) : expression(std::move(expr)) {}
+    static constexpr NodeKind Kind = NodeKind::ExpressionStatement;
+    Expression* expression;
+    explicit ExpressionStatement(Expression* expr) : Statement(Kind), expression(expr) {}
 };
 
 struct ReturnStatement : Statement {
-    std::unique_ptr<Expression> expression;
-    explicit ReturnStatement(std::unique_ptr<Expression> expr) : expression(std::move(expr)) {}
+    static constexpr NodeKind Kind = NodeKind::Return;
+    Expression* expression;
+    explicit ReturnStatement(Expression* expr) : Statement(Kind), expression(expr) {}
 };
 
 struct IfStatement : Statement {
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<BlockStatement> thenBranch;
-    std::unique_ptr<BlockStatement> elseBranch;
+    static constexpr NodeKind Kind = NodeKind::If;
+    Expression* condition = nullptr;
+    BlockStatement* thenBranch = nullptr;
+    BlockStatement* elseBranch = nullptr;
+    IfStatement() : Statement(Kind) {}
 };
 
 struct ForStatement : Statement {
-    std::string iterator;
-    std::unique_ptr<Expression> start;
-    std::unique_ptr<Expression> end;
-    std::unique_ptr<BlockStatement> body;
+    static constexpr NodeKind Kind = NodeKind::For;
+    Symbol iterator = NoSymbol;
+    Expression* start = nullptr;
+    Expression* end = nullptr;
+    BlockStatement* body = nullptr;
+    ForStatement() : Statement(Kind) {}
 };
 
 struct WhileStatement : Statement {
-    std::unique_ptr<Expression> condition;
-    std::unique_ptr<BlockStatement> body;
+    static constexpr NodeKind Kind = NodeKind::While;
+    Expression* condition = nullptr;
+    BlockStatement* body = nullptr;
+    WhileStatement() : Statement(Kind) {}
 };
 
 struct PrintStatement : Statement {
-    std::string format;
-    std::vector<std::unique_ptr<Expression>> arguments;
+    static constexpr NodeKind Kind = NodeKind::Print;
+    std::string_view format;
+    Span<Expression*> arguments;
     bool formatted;
-    PrintStatement(std::string fmt, std::vector<std::unique_ptr<Expression>> args, bool isFormatted)
-        : format(std::move(fmt)), arguments(std::move(args)), formatted(isFormatted) {}
+    PrintStatement(std::string_view fmt, Span<Expression*> args, bool isFormatted)
+        : Statement(Kind), format(fmt), arguments(args), formatted(isFormatted) {}
 };
 
 struct GatherStatement : Statement {
-    std::vector<std::string> names;
+    static constexpr NodeKind Kind = NodeKind::Gather;
+    Span<Symbol> names;
+    GatherStatement() : Statement(Kind) {}
 };
 
 struct FunctionDefinition : Statement {
-    std::string name;
-    std::string ns;
-    std::string returnType;
-    std::vector<Parameter> parameters;
-    std::unique_ptr<BlockStatement> body;
+    static constexpr NodeKind Kind = NodeKind::FunctionDefinition;
+    Symbol name = NoSymbol;
+    std::string_view returnType;
+    Span<Parameter> parameters;
+    BlockStatement* body = nullptr;
+    // Left unparsed by a lazy parse: the braced body text, a view into the
+    // source buffer, and the line it starts on. body stays null until
+    // Parser::parseDeferredBody fills it in.
+    std::string_view deferredBody;
+    int deferredLine = 0;
+    FunctionDefinition() : Statement(Kind) {}
 };
 
 struct ModuleImport : Statement {
-    std::string path;
-    std::string alias;
+    static constexpr NodeKind Kind = NodeKind::ModuleImport;
+    std::string_view path;
+    Symbol alias = NoSymbol;
+    ModuleImport() : Statement(Kind) {}
+};
+
+// Tag-based type tests, in the spirit of LLVM's isa/cast/dyn_cast.
+template <typename T>
+bool isa(const ASTNode* node) {
+    if constexpr (std::is_same<T, Expression>::value || std::is_same<T, Statement>::value) {
+        return T::classof(node->kind);
+    } else {
+        return node->kind == T::Kind;
+    }
+}
+
+template <typename T>
+T* cast(ASTNode* node) {
+    assert(isa<T>(node));
+    return static_cast<T*>(node);
+}
+
+template <typename T>
+const T* cast(const ASTNode* node) {
+    assert(isa<T>(node));
+    return static_cast<const T*>(node);
+}
+
+template <typename T>
+T* dyn_cast(ASTNode* node) {
+    return node && isa<T>(node) ? static_cast<T*>(node) : nullptr;
+}
+
+template <typename T>
+const T* dyn_cast(const ASTNode* node) {
+    return node && isa<T>(node) ? static_cast<const T*>(node) : nullptr;
+}
+
+// Calls fn with the node downcast to its concrete type. Every overload of fn
+// must return the same type; the switch is exhaustive over each hierarchy.
+template <typename Fn>
+decltype(auto) visit(Expression* expr, Fn&& fn) {
+    switch (expr->kind) {
+        case NodeKind::Number: return fn(static_cast<NumberExpression*>(expr));
+        case NodeKind::Float: return fn(static_cast<FloatExpression*>(expr));
+        case NodeKind::String: return fn(static_cast<StringExpression*>(expr));
+        case NodeKind::Bool: return fn(static_cast<BoolExpression*>(expr));
+        case NodeKind::Variable: return fn(static_cast<VariableExpression*>(expr));
+        case NodeKind::Unary: return fn(static_cast<UnaryExpression*>(expr));
+        case NodeKind::Binary: return fn(static_cast<BinaryExpression*>(expr));
+        case NodeKind::Assignment: return fn(static_cast<AssignmentExpression*>(expr));
+        default: break;
+    }
+    return fn(cast<CallExpression>(expr));
+}
+
+template <typename Fn>
+decltype(auto) visit(Statement* stmt, Fn&& fn) {
+    switch (stmt->kind) {
+        case NodeKind::Block: return fn(static_cast<BlockStatement*>(stmt));
+        case NodeKind::VariableDeclaration: return fn(static_cast<VariableDeclaration*>(stmt));
+        case NodeKind::AssignmentStatement: return fn(static_cast<AssignmentStatement*>(stmt));
+        case NodeKind::ExpressionStatement: return fn(static_cast<ExpressionStatement*>(stmt));
+        case NodeKind::Return: return fn(static_cast<ReturnStatement*>(stmt));
+        case NodeKind::If: return fn(static_cast<IfStatement*>(stmt));
+        case NodeKind::For: return fn(static_cast<ForStatement*>(stmt));
+        case NodeKind::While: return fn(static_cast<WhileStatement*>(stmt));
+        case NodeKind::Print: return fn(static_cast<PrintStatement*>(stmt));
+        case NodeKind::Gather: return fn(static_cast<GatherStatement*>(stmt));
+        case NodeKind::FunctionDefinition: return fn(static_cast<FunctionDefinition*>(stmt));
+        default: break;
+    }
+    return fn(cast<ModuleImport>(stmt));
+}
+
+// Owns every node of one module's tree. Destroying the context frees the
+// whole tree in one pass over the arena's chunks.
+class ASTContext {
+public:
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "AST nodes are never destroyed");
+        return arena.make<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    Span<T> list(const std::vector<T>& items) {
+        return arena.copy(items);
+    }
+
+    std::string_view text(std::string_view value) {
+        return arena.copy(value);
+    }
+
+    // Keeps other's nodes alive for as long as this context.
+    void adopt(ASTContext&& other) { arena.adopt(std::move(other.arena)); }
+
+    size_t bytesAllocated() const { return arena.bytesAllocated(); }
+
+private:
+    Arena arena;
 };
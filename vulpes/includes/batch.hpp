@@ -0,0 +1,10 @@
+#pragma once
+#include "driver.hpp"
+
+// Compiles every program in options.inputs and options.batchFile
+// concurrently, options.jobs at a time, sharing one session so modules that
+// several programs import are parsed once. Each program's executable is
+// named after its source (progs/a.vlp -> progs/a) unless the batch file
+// gives one. Output and diagnostics are buffered per program and printed as
+// one block, in input order. Returns 1 if any program failed.
+int runBatch(const CompileOptions& options);
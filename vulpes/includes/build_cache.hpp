@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Content-addressed cache of whole builds, shared by every compile that
+// points at the same directory, concurrently or not:
+//
+//   manifests/<source key>   the modules the root file needed last time and
+//                            what each import statement resolved to
+//   entries/<build key>/     main.ll, main.o (when built) and the executable
+//
+// The source key covers the compiler build, the codegen options and the
+// root file's canonical path and normalized text; the build key adds the
+// normalized text each transitive import was compiled from and where each
+// import statement led. A lookup only reads, resolves and hashes files,
+// so a hit skips lexing, parsing, code generation and every external tool.
+// Entries are published with a rename and the least recently used are
+// evicted once the cache outgrows its capacity.
+class BuildCache {
+public:
+    BuildCache(std::string dir, std::uint64_t capacityBytes);
+
+    std::string sourceKey(std::string_view source, std::string_view rootPath, std::string_view options) const;
+
+    // On a hit, copies the cached IR to llFile, unless it is empty, and the
+    // executable to output.
+    bool fetch(const std::string& sourceKey, const std::string& llFile, const std::string& output) const;
+
+    // A module the build imported: its canonical path and the text it was
+    // parsed from, which the file on disk may no longer match.
+    struct Import {
+        std::string path;
+        std::string_view source;
+    };
+    // An import statement: the importing file's directory, the path as
+    // written and the canonical path of the file it named.
+    struct Resolution {
+        std::string directory;
+        std::string path;
+        std::string resolved;
+    };
+    // Publishes a finished build of sourceKey's root file with its
+    // transitive imports and how they were found. llFile and objFile may be
+    // empty for a build that never wrote them. Errors are swallowed: the
+    // cache only saves time.
+    void store(const std::string& sourceKey, const std::vector<Import>& imports, std::vector<Resolution> resolutions,
+               const std::string& llFile, const std::string& objFile, const std::string& output);
+
+private:
+    std::string dir;
+    std::uint64_t capacity;
+
+    using ImportDigest = std::pair<std::string, std::string>; // path, hash of its normalized text
+
+    std::string buildKey(const std::string& sourceKey, const std::vector<ImportDigest>& imports,
+                         const std::vector<Resolution>& resolutions) const;
+    void evict(const std::string& keep);
+};
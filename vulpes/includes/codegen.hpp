@@ -1,8 +1,15 @@
 #pragma once
 #include "ast.hpp"
+#include "module_cache.hpp"
+#include "module_graph.hpp"
+#include "symbol.hpp"
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <sstream>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 struct VariableInfo {
@@ -11,29 +18,125 @@ struct VariableInfo {
 };
 
 struct FunctionInfo {
-    std::string key;      // lookup key (ns.name or name)
+    QualifiedName key;    // module scope (NoSymbol for the root file) and name
     std::string irName;   // LLVM-visible name
     std::string returnType;
-    std::vector<Parameter> parameters;
+    Span<Parameter> parameters;
     FunctionDefinition* definition;
 };
 
+// One object file's worth of a separately compiled program: the root file
+// or one imported module.
+struct CompilationUnit {
+    Module* module = nullptr; // nullptr for the root file
+    std::string name;         // "root", or "mod_" and the module's IR prefix
+    std::uint64_t key = 0;    // changes whenever the unit's IR might
+};
+
+class ErrorHandler;
+class ThreadPool;
+
+// The printf format for a print statement: each {} in format, then each
+// argument left over, becomes the conversion for the argument's LLVM type.
+// Always ends in a newline.
+std::string printfFormat(std::string_view format, const std::vector<std::string>& argumentTypes);
+
 class CodeGenerator {
 public:
-    CodeGenerator();
-    std::string generate(const std::vector<std::unique_ptr<Statement>>& statements);
+    // Imports are resolved through moduleCache, which may be shared; the
+    // import graph is loaded on pool when one is given.
+    explicit CodeGenerator(ModuleCache& moduleCache, ThreadPool* pool = nullptr);
+    // Where imported modules' syntax errors go; std::cerr by default.
+    void setDiagnostics(std::ostream& out) { diagnostics = &out; }
+    // The root file's own imports are looked up next to path first, then as
+    // given.
+    void setRootPath(const std::string& path) { rootPath = path; }
+    std::string generate(const std::vector<Statement*>& statements);
+
+    // A function generate() lowers, with its body parsed; owner is nullptr
+    // for the root file's functions.
+    struct PlannedFunction {
+        FunctionDefinition* definition;
+        const FunctionInfo* info;
+        Module* owner;
+    };
+    // Binds the program like generate() and lists what it lowers, in order:
+    // the module functions reachable from the root file, then the root
+    // file's own. For backends other than the textual one, together with
+    // resolveFunction and mapType.
+    std::vector<PlannedFunction> plan(const std::vector<Statement*>& statements);
+    // The function call names when made from caller's code (nullptr for the
+    // root file); nullptr if there is none. Valid after plan().
+    const FunctionInfo* resolveFunction(const CallExpression* call, const Module* caller) const;
+    // LLVM type name for a Vulpes type name.
+    std::string mapType(std::string_view type) const;
+    // The import graph of the last bound program; nullptr before the first.
+    const ModuleGraph* importGraph() const { return graph.get(); }
+    // Streaming: lowers the root file's functions one at a time, then the
+    // module functions they reach, writing each one's IR and string
+    // constants to out as soon as it is done. statements come from a lazy
+    // parse of rootSource (see Parser::setLazyBodies), and every body is
+    // parsed into a scratch context freed right after lowering, so memory
+    // follows the largest function rather than the whole program. Functions
+    // come out in a different order than generate() gives. Returns false if
+    // a root body has syntax errors, which are recorded in rootErrors.
+    bool generateStreaming(const std::vector<Statement*>& statements, std::string_view rootSource,
+                           ErrorHandler& rootErrors, std::ostream& out);
+
+    // Watch mode: keep each function's IR between generate() calls and reuse
+    // it while the function's structure, and every signature and alias it
+    // could see, are unchanged. Temporaries, labels and string constants are
+    // then numbered per function, so one function's text never depends on
+    // another's.
+    void setFunctionCaching(bool enabled) { cacheFunctions = enabled; }
+    // Functions lowered and reused by the last generate().
+    size_t functionsEmitted() const { return emittedCount; }
+    size_t functionsReused() const { return reusedCount; }
+
+    // Separate compilation. units() binds the program like generate() and
+    // lists its units; a unit's key covers its own source (rootContentHash
+    // for the root file) and the signatures of everything it can call.
+    // generateUnit() lowers one unit, declaring what it calls in others.
+    std::vector<CompilationUnit> units(const std::vector<Statement*>& statements, std::uint64_t rootContentHash);
+    std::string generateUnit(const CompilationUnit& unit);
 
 private:
+    ModuleCache& moduleCache;
+    ThreadPool* pool;
+    std::ostream* diagnostics;
+    std::string rootPath;
     int tempCounter;
     int strCounter;
     int labelCounter;
 
     std::ostringstream globals;
     std::ostringstream body;
-    std::unordered_map<std::string, FunctionInfo> functions;
+    std::unordered_map<QualifiedName, FunctionInfo, QualifiedNameHash> functions;
+    std::unordered_map<const Module*, Symbol> moduleScopes;
+    // importer (nullptr for the root file) -> alias -> module scope
+    std::unordered_map<const Module*, std::unordered_map<Symbol, Symbol>> aliases;
+    const Module* currentModule = nullptr; // owner of the function being emitted
+    std::unique_ptr<ModuleGraph> graph;
+    const std::vector<Statement*>* rootStatements = nullptr;
+    std::vector<const FunctionInfo*> calledFunctions; // first-call order
+    std::unordered_set<const FunctionInfo*> called;
+
+    struct CachedFunction {
+        std::uint64_t shape = 0; // structure and environment it was built for
+        std::string ir;
+        std::string globals; // the string constants it emitted
+        unsigned generation = 0; // last generate() that used it
+    };
+    bool cacheFunctions = false;
+    std::uint64_t environment = 0; // signatures and aliases, set by bind()
+    std::string stringPrefix;      // owner of the string constants being named
+    std::unordered_map<std::string, CachedFunction> functionCache; // by IR name
+    size_t emittedCount = 0;
+    size_t reusedCount = 0;
+    unsigned generation = 0;
 
     struct Scope {
-        std::unordered_map<std::string, VariableInfo> variables;
+        std::unordered_map<Symbol, VariableInfo> variables;
     };
     std::vector<Scope> scopes;
 
@@ -41,18 +144,47 @@ private:
     std::string nextTemp();
     std::string nextStringName();
     std::string nextLabel(const std::string& base);
-    std::string mapType(const std::string& type) const;
-    VariableInfo* resolveVariable(const std::string& name);
+    VariableInfo* resolveVariable(Symbol name);
     void pushScope();
     void popScope();
 
     // generation
-    void registerFunction(FunctionDefinition* func);
-    void registerImportedFunctions(const std::vector<std::unique_ptr<Statement>>& module, const std::string& ns);
-    void emitBuiltins(std::ostringstream& out);
+    void bind(const std::vector<Statement*>& statements);
+    // scope is the module's scope symbol (NoSymbol for the root file); it
+    // also prefixes the function's IR name.
+    void registerFunction(FunctionDefinition* func, Symbol scope);
+    void registerImportedFunctions(const Module& module, Symbol scope);
+    // Only one object of a program may define the runtime's globals.
+    void emitBuiltins(std::ostringstream& out, bool defineRuntimeState = true);
     void emitFormatGlobals();
-    std::string emitFunction(FunctionDefinition* func, const std::string& irName);
+    // body is func's, passed separately so it need not be attached to func.
+    std::string emitFunction(FunctionDefinition* func, const std::string& irName, const BlockStatement* body);
+    std::string emitFunctionCached(FunctionDefinition* func, const std::string& irName);
     bool emitStatement(Statement* stmt, const std::string& currentReturn);
     std::string emitExpression(Expression* expr, std::string& outType);
+
+    // Per-node emitters reached through visit(); statements return true
+    // when they terminate the current block.
+    bool emit(BlockStatement* block, const std::string& currentReturn);
+    bool emit(VariableDeclaration* decl, const std::string& currentReturn);
+    bool emit(AssignmentStatement* assign, const std::string& currentReturn);
+    bool emit(ExpressionStatement* exprStmt, const std::string& currentReturn);
+    bool emit(ReturnStatement* ret, const std::string& currentReturn);
+    bool emit(PrintStatement* print, const std::string& currentReturn);
+    bool emit(GatherStatement* gather, const std::string& currentReturn);
+    bool emit(IfStatement* ifStmt, const std::string& currentReturn);
+    bool emit(WhileStatement* whileStmt, const std::string& currentReturn);
+    bool emit(ForStatement* forStmt, const std::string& currentReturn);
+    bool emit(FunctionDefinition* func, const std::string& currentReturn);
+    bool emit(ModuleImport* mod, const std::string& currentReturn);
+    std::string emit(NumberExpression* num, std::string& outType);
+    std::string emit(FloatExpression* fl, std::string& outType);
+    std::string emit(StringExpression* str, std::string& outType);
+    std::string emit(BoolExpression* bl, std::string& outType);
+    std::string emit(VariableExpression* var, std::string& outType);
+    std::string emit(UnaryExpression* unary, std::string& outType);
+    std::string emit(BinaryExpression* bin, std::string& outType);
+    std::string emit(CallExpression* call, std::string& outType);
+    std::string emit(AssignmentExpression* assign, std::string& outType);
     std::string convert(const std::string& value, const std::string& from, const std::string& to);
 };
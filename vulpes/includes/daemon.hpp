@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// A long-running compiler that keeps one CompilerSession warm: source
+// buffers, parsed modules, interned symbols and the worker pool survive
+// between requests, so a request only pays for what changed. Clients send
+// their working directory and command line over a Unix domain socket; the
+// daemon answers with the compile's output, diagnostics and exit status.
+// The socket is only open to the daemon's own user, and both ends check the
+// other's user ID before trusting it.
+
+// $XDG_RUNTIME_DIR/vulpes.sock, or /tmp/vulpes-<uid>/daemon.sock without
+// one; the daemon creates that directory private to its user.
+std::string defaultSocketPath();
+
+// Serves requests until a client sends --shutdown; returns the exit status.
+int runDaemon(const std::string& socketPath, unsigned jobs, const std::string& moduleCacheDir);
+
+// Sends args to the daemon and relays its output to stdout and stderr. False
+// if no daemon of this user is listening, so the caller can compile locally
+// instead.
+bool runClient(const std::string& socketPath, const std::vector<std::string>& args, int& status);
@@ -0,0 +1,88 @@
+#pragma once
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "module_cache.hpp"
+#include "source_manager.hpp"
+#include "thread_pool.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+// "llvm" in builds with the IRBuilder backend, "text" otherwise.
+const char* defaultBackend();
+
+// What one command line asks for.
+struct CompileOptions {
+    std::string input = "main.vlp";
+    std::string output = "a.out";
+    bool showLLVM = false;
+    bool runExec = false;
+    bool clean = false;
+    bool moduleStats = false;
+    bool watch = false;
+    bool stream = false; // lower and write one function at a time
+    // "llvm": build the module, the object and the executable in process,
+    // for single-object compiles; "text": format IR for external tools. llvm
+    // by default where it is built in (vulpes-llvm).
+    std::string backend = defaultBackend();
+    // --run in process under the JIT (llvm backend only), with no executable
+    // written; implies runExec.
+    bool jit = false;
+    bool batch = false;
+    std::vector<std::string> inputs; // every .vlp argument, for --batch
+    std::string batchFile;           // more inputs, one per line
+    unsigned jobs = 0; // 0: one per hardware thread
+    std::string moduleCacheDir;
+    std::string buildDir; // set: compile each module separately, incrementally
+    std::string cacheDir; // whole-build cache; VULPES_CACHE_DIR by default
+    std::uint64_t cacheMegabytes = 512;
+
+    // Makes every path absolute against cwd, for a compile run elsewhere.
+    void resolvePaths(const std::string& cwd);
+};
+
+// Unrecognized arguments are ignored. Throws std::invalid_argument for a
+// backend this build lacks or --jit without the llvm backend, and it or
+// std::out_of_range for a malformed number.
+CompileOptions parseArguments(const std::vector<std::string>& args);
+
+// What outlives a single compile: source buffers, parsed modules and the
+// worker pool. A daemon keeps one session, tracking file changes, for its
+// whole life.
+struct CompilerSession {
+    CompilerSession(bool trackChanges, unsigned jobs, const std::string& moduleCacheDir);
+
+    SourceManager sources;
+    ModuleCache modules;
+    std::unique_ptr<ThreadPool> pool;
+};
+
+// Runs one compile, writing normal output to out and diagnostics to err, and
+// returns the exit status. Throws std::runtime_error for I/O failures and
+// module errors, as main reports them.
+int compile(const CompileOptions& options, CompilerSession& session, std::ostream& out, std::ostream& err);
+
+// Backend steps, run as external tools: clang when it is installed,
+// otherwise llc and gcc. Both return false if the tool failed.
+bool compileObject(const std::string& llFile, const std::string& objFile);
+bool linkExecutable(const std::vector<std::string>& objects, const std::string& output);
+// The tools those use, for keying caches on them.
+const char* backendName();
+
+// Separate compilation into buildDir: each unit is lowered to its own .ll
+// and object file, and a manifest records the key each object was built
+// from. Only units whose key changed go through the backend again, on pool
+// when one is given; the executable is relinked if any object changed.
+struct IncrementalResult {
+    size_t units = 0;
+    size_t rebuilt = 0;
+    bool relinked = false;
+};
+
+// Throws std::runtime_error if buildDir can't be used or a tool fails.
+IncrementalResult buildIncrementally(CodeGenerator& generator, const std::vector<Statement*>& program,
+                                     std::uint64_t rootContentHash, const std::string& buildDir,
+                                     const std::string& output, ThreadPool* pool);
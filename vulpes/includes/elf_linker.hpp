@@ -0,0 +1,14 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A minimal linker for what vulpes itself produces: x86-64 ELF relocatable
+// objects whose only outside references are functions in libc and libm.
+// They are laid out into a non-PIE executable that the system's dynamic
+// loader binds to those libraries at startup, with a built-in _start in
+// place of crt1.o. Returns false, with the reason in error, for anything
+// outside that case (a host without glibc's loader, TLS, common symbols,
+// constructors, unknown relocations), so the caller can fall back to the
+// system linker.
+bool linkElfExecutable(const std::vector<std::string_view>& objects, const std::string& output, std::string& error);
@@ -1,4 +1,5 @@
 #pragma once
+#include "source_manager.hpp"
 #include <string>
 #include <vector>
 #include <iostream>
@@ -22,15 +23,22 @@ struct CompilerError {
     ErrorSeverity severity;
     SourceLocation location;
     std::string message;
-    std::string context; // The line of code that caused the error
     
-    CompilerError(ErrorSeverity sev, const SourceLocation& loc, const std::string& msg, const std::string& ctx = "")
-        : severity(sev), location(loc), message(msg), context(ctx) {}
+    CompilerError(ErrorSeverity sev, const SourceLocation& loc, const std::string& msg)
+        : severity(sev), location(loc), message(msg) {}
 };
 
 class ErrorHandler {
 public:
-    ErrorHandler(const std::string& sourceCode = "", const std::string& filename = "");
+    // Source lines for context are looked up in the manager only when an
+    // error is printed. file may be InvalidFileID for text the manager
+    // doesn't hold; errors are then printed without a file or context.
+    ErrorHandler(const SourceManager& sources, FileID file);
+
+    // Empty handler for the same file, e.g. for one thread's share of a
+    // parse; fold it back in with merge(), in source order.
+    ErrorHandler forSameFile() const;
+    void merge(ErrorHandler&& other);
     
     // Add an error
     void addError(ErrorSeverity severity, const SourceLocation& location, const std::string& message);
@@ -46,18 +54,20 @@ public:
     bool hasErrors() const;
     bool hasFatal() const;
     size_t getErrorCount() const;
+    const std::vector<CompilerError>& getErrors() const { return errors; }
     
     // Display all errors
-    void printErrors() const;
+    void printErrors(std::ostream& out = std::cerr) const;
     
     // Get a specific line from source for context
     std::string getSourceLine(int lineNumber) const;
 
 private:
     std::vector<CompilerError> errors;
-    std::vector<std::string> sourceLines;
+    const SourceManager& sources;
+    FileID file;
     std::string filename;
     
-    void printError(const CompilerError& error) const;
+    void printError(const CompilerError& error, std::ostream& out) const;
     std::string severityToString(ErrorSeverity severity) const;
 };
\ No newline at end of file
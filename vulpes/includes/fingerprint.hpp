@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 64-bit FNV-1a. Used to tell versions of a file apart, not as a
+// cryptographic hash.
+inline std::uint64_t fnv1a(std::string_view text, std::uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// SHA-256 as 64 lowercase hex digits, for keys shared between machines.
+std::string sha256(std::string_view text);
+
+// Identifies the running compiler binary, so on-disk caches written by any
+// other build are ignored. Taken from the executable's size and contents, so
+// identical builds on different hosts agree.
+const std::string& compilerStamp();
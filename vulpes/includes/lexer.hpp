@@ -1,27 +1,39 @@
 #pragma once
+#include "symbol.hpp"
+
+#include <cstddef>
+#include <deque>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// Every reserved word as (TokenType, spelling). This one list defines the
+// keyword token types and builds the lexer's keyword hash table.
+#define VULPES_KEYWORDS(X) \
+    X(True, "true")        \
+    X(False, "false")      \
+    X(Var, "var")          \
+    X(Const, "const")      \
+    X(Fx, "fx")            \
+    X(If, "if")            \
+    X(Else, "else")        \
+    X(For, "for")          \
+    X(In, "in")            \
+    X(While, "while")      \
+    X(Return, "return")    \
+    X(Print, "print")      \
+    X(Gather, "gather")    \
+    X(Mod, "mod")
+
 enum class TokenType {
     Identifier,
     Number,
     Float,
     String,
-    True,
-    False,
     // keywords
-    Var,
-    Const,
-    Fx,
-    If,
-    Else,
-    For,
-    In,
-    While,
-    Return,
-    Print,
-    Gather,
-    Mod,
+#define VULPES_KEYWORD_TOKEN(type, spelling) type,
+    VULPES_KEYWORDS(VULPES_KEYWORD_TOKEN)
+#undef VULPES_KEYWORD_TOKEN
     // punctuation/operators
     Arrow,
     Colon,
@@ -49,17 +61,77 @@ enum class TokenType {
     Unknown
 };
 
+// Lexemes are views into the source buffer handed to the Lexer, except for
+// string literals containing escapes, which live in the lexer's literal arena.
+// Either way a token is only valid while both the source and the Lexer live.
 struct Token {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;
     int line;
     int column;
+    Symbol symbol = NoSymbol; // interned name, identifiers only
+};
+
+// Byte offset into a source buffer and the 1-based line it falls on.
+struct SourceOffset {
+    size_t offset;
+    int line;
 };
 
+// Pull-based lexer: tokens are produced one at a time by next(), so the
+// front end never holds more than the parser's lookahead window.
 class Lexer {
 public:
-    explicit Lexer(const std::string& source);
-    std::vector<Token> tokens;
+    explicit Lexer(std::string_view source);
+    // Lexes only source[begin.offset, stop); lines and columns are still
+    // those of the whole buffer.
+    Lexer(std::string_view source, SourceOffset begin, size_t stop);
+    Lexer(std::string&&) = delete; // tokens would dangle into a temporary
+
+    // Start of every `fx` keyword outside braces, in source order. Runs a
+    // full lex without interning identifiers; used to split a file into
+    // independently parseable pieces.
+    static std::vector<SourceOffset> topLevelFunctions(std::string_view source);
+
+    // Returns the next token; keeps returning EndOfFile once input runs out.
+    Token next();
+
+    // Consumes tokens until depth more '}' than '{' have been seen, without
+    // interning identifiers. Returns the position just past the last '}',
+    // or nullptr if input runs out first.
+    const char* skipBlock(int depth);
+
+private:
+    const char* cursor;
+    const char* end;
+    const char* lineStart;
+    int line;
+    bool internIdentifiers = true;
+    std::deque<std::string> literals; // materialized escaped string literals
+
+    int column(const char* at) const;
+    Token make(TokenType type, std::string_view lexeme, const char* at, Symbol symbol = NoSymbol) const;
+};
+
+// Bounded lookahead over a Lexer. The current token is always buffered;
+// peek(n) pulls further tokens into a fixed ring on demand.
+class TokenStream {
+public:
+    static constexpr size_t Lookahead = 4; // power of two
+
+    explicit TokenStream(Lexer& lexer);
+
+    const Token& current() const;
+    const Token& peek(size_t distance); // distance < Lookahead
+    void advance();
+
+    // With current() on a '{', skips through its matching '}' and returns
+    // the position just past it; nullptr (at EndOfFile) if it is unclosed.
+    const char* skipBlock();
+
 private:
-    void add(TokenType type, const std::string& lexeme, int line, int column);
+    Lexer& lexer;
+    Token ring[Lookahead];
+    size_t head;
+    size_t count;
 };
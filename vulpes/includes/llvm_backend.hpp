@@ -0,0 +1,45 @@
+#pragma once
+#include "ast.hpp"
+#include "codegen.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Lowers a program straight to an in-memory llvm::Module through
+// llvm::IRBuilder, rather than formatting IR text for another tool to parse
+// again, and compiles that to an object file in memory. The program is
+// bound and planned by a CodeGenerator and behaves as its textual IR does.
+// Only in builds with LLVM (VULPES_HAVE_LLVM); LLVM's own headers stay out
+// of this one.
+class LLVMBackend {
+public:
+    LLVMBackend();
+    ~LLVMBackend();
+    LLVMBackend(const LLVMBackend&) = delete;
+    LLVMBackend& operator=(const LLVMBackend&) = delete;
+
+    // Replaces the module with program, for the host; values are named after variables
+    // and parameters only if keepNames. Throws std::runtime_error if the
+    // result does not verify, as a type error in the program can make it.
+    void lower(CodeGenerator& frontend, const std::vector<Statement*>& program, bool keepNames = false);
+
+    // The module as textual IR, for --show-llvm.
+    std::string text() const;
+    // Runs LLVM's code generator for the host on the module, which changes
+    // it, so text() is only meaningful before. Returns the object file.
+    std::string emitObject();
+
+    struct JitRun {
+        int status = 0; // what main returned
+        double compileMilliseconds = 0;
+        double runMilliseconds = 0;
+    };
+    // Compiles the module with ORC's LLJIT instead, binding the C library
+    // functions it declares to this process's own, and calls its main. The
+    // module is used up. Throws std::runtime_error if the JIT fails.
+    JitRun runJit();
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
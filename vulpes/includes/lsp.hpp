@@ -0,0 +1,14 @@
+#pragma once
+#include <iosfwd>
+
+// A Language Server Protocol server over in and out (stdin and stdout for
+// `vulpes --lsp`). Each open document is kept as a run of chunks, one per
+// top-level fx (the first also holds whatever precedes it), each with its
+// own AST and diagnostics. An edit re-lexes from the first chunk it touches
+// only until the chunk boundaries line up with the old ones again, and
+// reparses just the chunks in between. Supports incremental text sync,
+// publishDiagnostics and go-to-definition, including namespaced calls such
+// as math.adder, which are looked up in the imported module.
+//
+// Returns the exit status: 0 after shutdown and exit, 1 otherwise.
+int runLanguageServer(std::istream& in, std::ostream& out);
@@ -0,0 +1,96 @@
+#pragma once
+#include "ast.hpp"
+#include "error_handler.hpp"
+#include "module_interface.hpp"
+#include "source_manager.hpp"
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One parsed version of a source file, shared by every import that names it
+// and kept alive by whoever holds it (see ModuleCache::load). Function
+// bodies are parsed lazily (see Parser::setLazyBodies), so the AST grows as
+// bodies are requested through ModuleCache::parseBody.
+struct Module {
+    FileID file = InvalidFileID;
+    std::string canonicalPath;
+    std::uint64_t contentHash = 0;
+    std::unique_ptr<ASTContext> context;
+    std::vector<Statement*> statements;
+    std::unique_ptr<ErrorHandler> parseErrors; // from the declaration-level parse
+    bool hasErrors = false;
+    unsigned imports = 0; // load() calls that returned this module
+    // Set when the module was loaded from a .vlpc file instead of parsed;
+    // bodies are then decoded from it on demand.
+    std::unique_ptr<ModuleInterface> interface;
+
+    std::once_flag parsed; // the first importer parses, later ones wait
+    std::mutex bodyMutex;  // serializes lazy body parses
+};
+
+// Parses each imported file once per canonical path and version and hands
+// the same Module to every importer. Safe to share between threads;
+// different modules are parsed concurrently, outside the cache lock.
+class ModuleCache {
+public:
+    explicit ModuleCache(SourceManager& sources);
+    ModuleCache(const ModuleCache&) = delete;
+    ModuleCache& operator=(const ModuleCache&) = delete;
+
+    // Enables the .vlpc cache: each module is first looked up in dir, and a
+    // freshly parsed module without errors is written there. Off by default.
+    void setInterfaceDirectory(std::string dir);
+
+    // The module at path, parsed on first use; nullptr if it can't be read.
+    // cached is set to whether the module was already in the cache. When
+    // the source manager reads a newer version of the file, its module
+    // replaces this one in the cache, and this one and its source are freed
+    // once the last caller holding it lets go.
+    std::shared_ptr<Module> load(const std::string& path, bool* cached = nullptr);
+
+    // Prints the module's declaration-level parse errors to out.
+    void reportErrors(Module& module, std::ostream& out);
+
+    // Fills func->body if a lazy parse left it empty; false on a syntax
+    // error, which is printed to out.
+    bool parseBody(Module& module, FunctionDefinition* func, std::ostream& out);
+    // func's body without growing the module's tree: one it already holds,
+    // or else one parsed or decoded into context, gone with context. If
+    // the module's .vlpc turns out damaged, the module's tree takes every
+    // body from the source instead. nullptr on a syntax error, which is
+    // printed to out.
+    const BlockStatement* transientBody(Module& module, const FunctionDefinition* func, ASTContext& context,
+                                        std::ostream& out);
+
+    SourceManager& sourceManager() { return sources; }
+
+    // Canonical path of every module loaded so far, once each.
+    std::vector<std::string> loadedPaths() const;
+
+    size_t hits() const;
+    size_t misses() const;
+    // One line per module: path, number of imports, how many were hits and
+    // whether it came from a .vlpc file.
+    void printStats(std::ostream& out) const;
+
+private:
+    void parse(Module& module);
+    // Parses every body a damaged .vlpc still owed the module from its
+    // source and rewrites the file. Throws std::runtime_error if the source
+    // no longer gives the same declarations.
+    void recoverFromSource(Module& module);
+    std::string interfacePath(const Module& module) const;
+
+    std::string interfaceDir;
+
+    SourceManager& sources;
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<Module>> modules; // latest version of each path, in load order
+    std::unordered_map<std::string, size_t> byPath; // canonical path -> index into modules
+    size_t hitCount = 0;
+    size_t missCount = 0;
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include "ast.hpp"
+#include "module_cache.hpp"
+#include "symbol.hpp"
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+// Every module reachable from a root file's imports, with each module's own
+// alias table. Imports are resolved relative to the importing file's
+// directory first, then as given. The graph holds its modules, so they
+// outlive newer versions of their files for as long as it does.
+class ModuleGraph {
+public:
+    struct Import {
+        Symbol alias;
+        Module* module;
+    };
+
+    // Loads the graph breadth-first; each level of newly discovered modules
+    // is read, lexed and parsed concurrently on pool when one is given.
+    // Parse errors are printed to diagnostics, once per module. Throws
+    // std::runtime_error for a missing module or an import cycle.
+    // rootPath names the root file; empty if it has none.
+    ModuleGraph(const std::vector<Statement*>& root, const std::string& rootPath, ModuleCache& cache,
+                ThreadPool* pool, std::ostream& diagnostics);
+
+    // One mod(...) statement as written and what it named: path relative to
+    // directory, the importing file's (with a trailing slash), if a file is
+    // there, else path as given.
+    struct Resolution {
+        std::string directory;
+        std::string path;
+        const Module* module;
+    };
+
+    const std::vector<Import>& rootImports() const { return roots; }
+    const std::vector<Import>& importsOf(const Module* module) const;
+
+    // Every module, each after all the modules it imports.
+    const std::vector<Module*>& topologicalOrder() const { return order; }
+    // What each import statement of the root file and the modules named.
+    const std::vector<Resolution>& resolutions() const { return resolved; }
+
+private:
+    std::vector<std::shared_ptr<Module>> held;
+    std::vector<Import> roots;
+    std::unordered_map<const Module*, std::vector<Import>> edges;
+    std::vector<Module*> order;
+    std::vector<Resolution> resolved;
+
+    void sort();
+};
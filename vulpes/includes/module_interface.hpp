@@ -0,0 +1,40 @@
+#pragma once
+#include "ast.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary form of a parsed module (a .vlpc file): the module's symbol names,
+// its top-level declarations and, separately, each function body. A file is
+// only accepted if it was written by this build of the compiler (see
+// compilerStamp) for source text with the same content hash; anything else
+// is ignored, never trusted.
+class ModuleInterface {
+public:
+    // Encodes a module whose function bodies have all been parsed.
+    static std::string encode(const std::vector<Statement*>& statements, std::uint64_t contentHash);
+
+    // Decodes the declarations in bytes into context and statements. Function
+    // bodies stay encoded until readBody is asked for them. nullptr if bytes
+    // is damaged, stale or from another compiler build.
+    static std::unique_ptr<ModuleInterface> decode(std::string bytes, std::uint64_t contentHash,
+                                                   ASTContext& context, std::vector<Statement*>& statements);
+
+    // Hash of func's encoded form: equal for functions that differ at most in
+    // layout, comments or position.
+    static std::uint64_t structuralHash(FunctionDefinition* func);
+
+    // Fills in func->body; false if the file holds no body for func. Throws
+    // std::runtime_error if the encoded body is damaged.
+    bool readBody(FunctionDefinition* func, ASTContext& context);
+    // Decodes func's body into context without attaching it; nullptr if the
+    // file holds none. Throws like readBody.
+    BlockStatement* decodeBody(const FunctionDefinition* func, ASTContext& context);
+
+private:
+    std::string bytes;
+    std::vector<Symbol> symbols;                                // file-local index -> Symbol
+    std::unordered_map<const FunctionDefinition*, size_t> bodies; // offset of each encoded body
+};
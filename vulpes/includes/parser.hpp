@@ -2,46 +2,94 @@
 #include "lexer.hpp"
 #include "ast.hpp"
 #include "error_handler.hpp"
-#include <memory>
+#include <cstdint>
+#include <string_view>
 #include <vector>
 
+class ThreadPool;
+
+// Binding power of an operator; higher binds tighter.
+enum class Precedence : std::uint8_t {
+    None,
+    Assignment,
+    Comparison,
+    Term,
+    Factor,
+    Prefix
+};
+
 class Parser {
 public:
-    Parser(const std::vector<Token>& tokens, ErrorHandler& handler);
-    std::vector<std::unique_ptr<Statement>> parseProgram();
+    // Nodes are allocated in context, which must outlive the returned tree.
+    Parser(Lexer& lexer, ErrorHandler& handler, ASTContext& context);
+    std::vector<Statement*> parseProgram();
+
+    // In lazy mode function bodies are skipped, not parsed, and recorded in
+    // FunctionDefinition::deferredBody; syntax errors inside them surface
+    // only once the body is parsed.
+    void setLazyBodies(bool lazy) { lazyBodies = lazy; }
+
+    // Parses a body skipped by a lazy parse of source into func->body.
+    static bool parseDeferredBody(FunctionDefinition* func, std::string_view source,
+                                  ErrorHandler& handler, ASTContext& context);
+    // The same, but the body is returned instead of attached to func, so it
+    // lives only as long as context.
+    static BlockStatement* parseDeferredBlock(const FunctionDefinition* func, std::string_view source,
+                                              ErrorHandler& handler, ASTContext& context);
 
 private:
-    const std::vector<Token>& tokens;
-    size_t pos;
+    TokenStream tokens;
+    TokenType previousType; // type of the last consumed token
+    bool panicking = false; // an error was reported and recovery is pending
+    int blockDepth = 0;
+    bool lazyBodies = false;
     ErrorHandler& errorHandler;
+    ASTContext& context;
+
+    // An operator waiting for its right operand. Expressions are parsed with
+    // explicit operand/operator stacks so nesting depth costs heap, not
+    // native stack; nested calls share the stacks above their own base.
+    struct PendingOperator {
+        enum class Form : std::uint8_t { Binary, Negate, Assign, Group } form;
+        Precedence precedence;
+        BinaryOp op;
+        Symbol target; // assignment target for Form::Assign
+    };
+    std::vector<Expression*> operands;
+    std::vector<PendingOperator> operators;
 
     const Token& current() const;
     bool match(TokenType type);
     void advance();
     bool isAtEnd() const;
 
-    std::unique_ptr<Statement> declaration();
-    std::unique_ptr<Statement> statement();
-    std::unique_ptr<BlockStatement> block();
-    std::unique_ptr<Statement> ifStatement();
-    std::unique_ptr<Statement> forStatement();
-    std::unique_ptr<Statement> whileStatement();
-    std::unique_ptr<Statement> returnStatement();
-    std::unique_ptr<Statement> printStatement();
-    std::unique_ptr<Statement> gatherStatement();
-    std::unique_ptr<Statement> varDeclaration(bool isConst);
-    std::unique_ptr<Statement> functionDefinition();
-    std::unique_ptr<Statement> moduleImport();
-
-    std::unique_ptr<Expression> expression();
-    std::unique_ptr<Expression> assignment();
-    std::unique_ptr<Expression> comparison();
-    std::unique_ptr<Expression> term();
-    std::unique_ptr<Expression> factor();
-    std::unique_ptr<Expression> unary();
-    std::unique_ptr<Expression> call();
-    std::unique_ptr<Expression> primary();
+    Statement* declaration();
+    Statement* statement();
+    BlockStatement* block();
+    Statement* ifStatement();
+    Statement* forStatement();
+    Statement* whileStatement();
+    Statement* returnStatement();
+    Statement* printStatement();
+    Statement* gatherStatement();
+    Statement* varDeclaration(bool isConst);
+    Statement* functionDefinition();
+    Statement* moduleImport();
 
+    Expression* expression();
+    Expression* primary();
+    void reduce(size_t operatorBase, Precedence minimum);
+
+    // Errors are reported once and propagated as nullptr; the enclosing
+    // statement loop (top level or block) then calls synchronize().
+    void errorAtCurrent(const char* message);
+    bool expect(TokenType type, const char* message);
     void synchronize();
-    void expect(TokenType type, const std::string& message);
 };
+
+// Parses a whole buffer. Given a pool of two or more workers and a large
+// enough buffer, the buffer is cut at top-level fx declarations and the
+// pieces are parsed concurrently; statements and diagnostics are merged back
+// in source order, so the result is the same as a sequential parse.
+std::vector<Statement*> parseSource(std::string_view source, ErrorHandler& handler, ASTContext& context,
+                                    ThreadPool* pool = nullptr);
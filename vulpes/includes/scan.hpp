@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+
+// Byte-run kernels used by the lexer. Each scans [p, end) and returns the
+// first byte that ends the run, or end. SSE2/AVX2 versions are picked once at
+// startup from the host CPU; other targets use the scalar versions.
+namespace scan {
+
+// Locale-independent character classes; std::isspace and friends consult the
+// current locale on every call.
+inline bool isWhitespace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool isDigit(unsigned char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool isIdentifierStart(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+inline bool isIdentifierChar(unsigned char c) {
+    return isIdentifierStart(c) || isDigit(c);
+}
+
+// Runs of ' ', '\t', '\n', '\v', '\f', '\r'. Newlines inside the run are
+// counted into newlines and the last one is stored in lastNewline.
+const char* skipWhitespace(const char* p, const char* end, int& newlines, const char*& lastNewline);
+
+// Comment bodies: stops at '\n'.
+const char* findLineEnd(const char* p, const char* end);
+
+// Identifier tails: runs of [A-Za-z0-9_].
+const char* skipIdentifier(const char* p, const char* end);
+
+// String bodies: stops at '"', '\\' or '\n'.
+const char* findStringStop(const char* p, const char* end);
+
+} // namespace scan
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using FileID = int;
+constexpr FileID InvalidFileID = -1;
+
+// Owns the source buffers of a compilation. Each file is memory-mapped once
+// and its buffer stays at a stable address until the manager is destroyed,
+// so tokens and diagnostics can refer into it. Line tables are only built the
+// first time a diagnostic asks for a source line.
+//
+// A manager that outlives one compilation (trackChanges) instead re-checks a
+// file's size and modification time on every load and reads a changed file
+// under a new ID. Its buffers are copies, since a mapping would change or
+// fault under an earlier version's tokens when the file is rewritten. The
+// version a new ID supersedes is freed once nothing holds it.
+class SourceManager {
+public:
+    explicit SourceManager(bool trackChanges = false);
+    ~SourceManager();
+    SourceManager(const SourceManager&) = delete;
+    SourceManager& operator=(const SourceManager&) = delete;
+
+    // Maps the file, or returns its existing ID if the same file (by
+    // canonical path, and with the same contents if tracking changes) was
+    // already loaded. InvalidFileID if it can't be read. The caller holds
+    // the file until it calls release().
+    FileID load(const std::string& path);
+    // Gives back a hold taken by load(). Nothing may use a superseded file
+    // after its last hold is released.
+    void release(FileID file);
+
+    // Releases a load()'s hold when it goes out of scope.
+    class Hold {
+    public:
+        Hold(SourceManager& sources, FileID file) : sources(sources), file(file) {}
+        ~Hold() { sources.release(file); }
+        Hold(const Hold&) = delete;
+        Hold& operator=(const Hold&) = delete;
+
+    private:
+        SourceManager& sources;
+        FileID file;
+    };
+
+    std::string_view buffer(FileID file) const;
+    const std::string& path(FileID file) const;
+    const std::string& canonicalPath(FileID file) const;
+
+    // Text of a 1-based line without its newline; empty if out of range.
+    std::string_view line(FileID file, int lineNumber) const;
+
+private:
+    struct File;
+
+    bool trackChanges;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<File>> files;
+    std::unordered_map<std::string, FileID> byCanonicalPath;
+
+    const File& get(FileID file) const;
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Interned identifier. Equal names always map to the same Symbol, so
+// identifiers can be hashed and compared as integers.
+using Symbol = std::uint32_t;
+
+// The empty string; used for "no namespace" and unnamed slots.
+constexpr Symbol NoSymbol = 0;
+
+class SymbolTable {
+public:
+    // Process-wide table shared by the lexer, parser and code generator.
+    // Safe to use from several threads at once.
+    static SymbolTable& global();
+
+    Symbol intern(std::string_view text);
+    std::string_view name(Symbol symbol) const;
+    size_t size() const;
+
+private:
+    SymbolTable();
+
+    // Names are spread over independently locked shards so parser threads
+    // interning identifiers rarely contend. A Symbol is its index within
+    // the shard times ShardCount plus the shard number.
+    static constexpr size_t ShardCount = 16;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::deque<std::string> names; // deque keeps views into entries stable
+        std::unordered_map<std::string_view, Symbol> lookup;
+    };
+    Shard shards[ShardCount];
+};
+
+inline Symbol intern(std::string_view text) {
+    return SymbolTable::global().intern(text);
+}
+
+inline std::string_view symbolName(Symbol symbol) {
+    return SymbolTable::global().name(symbol);
+}
+
+// Module-qualified name such as math.adder; ns is NoSymbol when unqualified.
+struct QualifiedName {
+    Symbol ns;
+    Symbol name;
+
+    bool operator==(const QualifiedName& other) const {
+        return ns == other.ns && name == other.name;
+    }
+};
+
+struct QualifiedNameHash {
+    size_t operator()(const QualifiedName& q) const {
+        return std::hash<std::uint64_t>()((static_cast<std::uint64_t>(q.ns) << 32) | q.name);
+    }
+};
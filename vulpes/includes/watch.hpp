@@ -0,0 +1,10 @@
+#pragma once
+#include "driver.hpp"
+
+// Rebuilds options.input every time it or one of its imports is written,
+// until interrupted. The session tracks file changes, so only edited files
+// are lexed and parsed again, and the code generator keeps every function's
+// IR, so only functions whose structure or visible signatures changed are
+// lowered again. With options.runExec the program is rerun after each
+// successful build.
+int runWatch(const CompileOptions& options);
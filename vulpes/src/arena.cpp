@@ -0,0 +1,39 @@
+#include "arena.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+void* Arena::allocate(size_t size, size_t align) {
+    auto aligned = [align](char* p) {
+        auto address = reinterpret_cast<std::uintptr_t>(p);
+        return reinterpret_cast<char*>((address + align - 1) & ~(static_cast<std::uintptr_t>(align) - 1));
+    };
+    char* start = cursor ? aligned(cursor) : nullptr;
+    if (!start || start + size > limit) {
+        // Oversized requests get a chunk of their own
+        size_t chunkSize = size + align > nextChunkSize ? size + align : nextChunkSize;
+        if (nextChunkSize < ChunkSize) nextChunkSize *= 2;
+        chunks.emplace_back(new char[chunkSize]); // left uninitialized
+        cursor = chunks.back().get();
+        limit = cursor + chunkSize;
+        start = aligned(cursor);
+    }
+    cursor = start + size;
+    used += size;
+    return start;
+}
+
+void Arena::adopt(Arena&& other) {
+    for (auto& chunk : other.chunks) chunks.push_back(std::move(chunk));
+    used += other.used;
+    other.chunks.clear();
+    other.cursor = other.limit = nullptr;
+    other.used = 0;
+}
+
+std::string_view Arena::copy(std::string_view text) {
+    if (text.empty()) return {};
+    char* data = static_cast<char*>(allocate(text.size(), 1));
+    std::memcpy(data, text.data(), text.size());
+    return std::string_view(data, text.size());
+}
@@ -0,0 +1,98 @@
+#include "batch.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Program {
+    std::string input;
+    std::string output;
+};
+
+std::string directoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) return "";
+    return path.substr(0, slash + 1);
+}
+
+// One program per line: its source and, optionally, its executable, both
+// relative to the batch file. Blank lines and lines starting with # are
+// skipped.
+void readBatchFile(const std::string& path, std::vector<Program>& programs) {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("could not open " + path);
+    std::string base = directoryOf(path);
+    auto resolve = [&base](const std::string& name) { return name[0] == '/' ? name : base + name; };
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string input, output;
+        if (!(fields >> input) || input[0] == '#') continue;
+        fields >> output;
+        programs.push_back({resolve(input), output.empty() ? "" : resolve(output)});
+    }
+}
+
+struct Result {
+    int status = 0;
+    std::string out;
+    std::string err;
+};
+
+} // namespace
+
+int runBatch(const CompileOptions& options) {
+    std::vector<Program> programs;
+    for (const std::string& input : options.inputs) programs.push_back({input, ""});
+    if (!options.batchFile.empty()) readBatchFile(options.batchFile, programs);
+    if (programs.empty()) throw std::runtime_error("no programs to compile");
+
+    auto start = std::chrono::steady_clock::now();
+    // Programs are the unit of parallelism: the session gets no pool of its
+    // own, so no task ever waits on work queued behind it.
+    CompilerSession session(false, 1, options.moduleCacheDir);
+    ThreadPool pool(options.jobs);
+    std::vector<std::future<Result>> results;
+    for (const Program& program : programs) {
+        CompileOptions single = options;
+        single.input = program.input;
+        single.output = program.output.empty() ? program.input.substr(0, program.input.find_last_of('.'))
+                                               : program.output;
+        single.runExec = false;
+        single.moduleStats = false;
+        results.push_back(pool.submit([single, &session] {
+            Result result;
+            std::ostringstream out, err;
+            try {
+                result.status = compile(single, session, out, err);
+            } catch (const std::exception& ex) {
+                err << "Error: " << single.input << ": " << ex.what() << std::endl;
+                result.status = 1;
+            }
+            result.out = out.str();
+            result.err = err.str();
+            return result;
+        }));
+    }
+
+    size_t failed = 0;
+    for (auto& pending : results) {
+        Result result = pending.get();
+        std::cout << result.out << std::flush;
+        std::cerr << result.err << std::flush;
+        if (result.status != 0) ++failed;
+    }
+    if (options.moduleStats) session.modules.printStats(std::cerr);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Batch: " << programs.size() - failed << " of " << programs.size() << " programs built on "
+              << pool.size() << " workers in " << static_cast<long>(elapsed) << " ms" << std::endl;
+    return failed ? 1 : 0;
+}
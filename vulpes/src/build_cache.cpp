@@ -0,0 +1,251 @@
+#include "build_cache.hpp"
+#include "fingerprint.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <tuple>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char ExecutableName[] = "a.out";
+
+// Line endings and trailing whitespace don't change a program, except inside
+// a string literal, which can span lines and is kept byte for byte. Literals
+// and comments are found by the lexer's rules: a comment runs from // to the
+// end of the line, and a backslash in a literal escapes the next character.
+std::string normalize(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    size_t kept = 0; // end of the last literal, which trimming must not cross
+    bool inString = false;
+    bool inComment = false;
+    auto trim = [&] {
+        while (out.size() > kept && (out.back() == ' ' || out.back() == '\t' || out.back() == '\r')) out.pop_back();
+    };
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (inString) {
+            out.push_back(c);
+            if (c == '\\' && i + 1 < text.size()) {
+                out.push_back(text[++i]);
+            } else if (c == '"') {
+                inString = false;
+                kept = out.size();
+            }
+            continue;
+        }
+        if (c == '\n') {
+            trim();
+            out.push_back('\n');
+            inComment = false;
+            continue;
+        }
+        out.push_back(c);
+        if (inComment) continue;
+        if (c == '"') {
+            inString = true;
+        } else if (c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+            out.push_back(text[++i]);
+            inComment = true;
+        }
+    }
+    if (inString) return out;
+    trim();
+    if (out.empty() || out.back() != '\n') out.push_back('\n');
+    while (out.size() > kept + 1 && out[out.size() - 1] == '\n' && out[out.size() - 2] == '\n') out.pop_back();
+    return out;
+}
+
+bool readFile(const fs::path& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+// The file a mod(path) in a file in directory names, by the compiler's rules
+// (see ModuleGraph): next to the importer if one is there, else path as
+// given. "" if neither can be read.
+std::string resolveImport(const std::string& directory, const std::string& path) {
+    auto canonical = [](const fs::path& candidate) -> std::string {
+        std::error_code error;
+        if (!fs::is_regular_file(candidate, error) || !std::ifstream(candidate)) return "";
+        fs::path found = fs::canonical(candidate, error);
+        return error ? "" : found.string();
+    };
+    if (!directory.empty() && !path.empty() && path[0] != '/') {
+        std::string found = canonical(directory + path);
+        if (!found.empty()) return found;
+    }
+    return canonical(path);
+}
+
+// A name no other process or thread is using.
+std::string uniqueSuffix() {
+    static std::atomic<unsigned> counter{0};
+    return std::to_string(::getpid()) + "." + std::to_string(counter++);
+}
+
+// Copies via a temporary beside to, so readers never see half a file.
+void publishCopy(const fs::path& from, const fs::path& to) {
+    fs::path temporary = to.string() + ".tmp" + uniqueSuffix();
+    fs::copy_file(from, temporary, fs::copy_options::overwrite_existing);
+    std::error_code error;
+    fs::rename(temporary, to, error);
+    if (error) {
+        fs::remove(temporary, error);
+        throw fs::filesystem_error("could not replace", to, error);
+    }
+}
+
+} // namespace
+
+BuildCache::BuildCache(std::string dir, std::uint64_t capacityBytes) : dir(std::move(dir)), capacity(capacityBytes) {}
+
+std::string BuildCache::sourceKey(std::string_view source, std::string_view rootPath,
+                                  std::string_view options) const {
+    std::string text = compilerStamp();
+    text += '\0';
+    text += options;
+    text += '\0';
+    text += rootPath;
+    text += '\0';
+    text += normalize(source);
+    return sha256(text);
+}
+
+std::string BuildCache::buildKey(const std::string& sourceKey, const std::vector<ImportDigest>& imports,
+                                 const std::vector<Resolution>& resolutions) const {
+    std::string text = sourceKey;
+    for (const ImportDigest& import : imports) text += '\n' + import.first + ' ' + import.second;
+    for (const Resolution& resolution : resolutions) {
+        text += '\n' + resolution.directory + '\t' + resolution.path + '\t' + resolution.resolved;
+    }
+    return sha256(text);
+}
+
+bool BuildCache::fetch(const std::string& sourceKey, const std::string& llFile, const std::string& output) const {
+    std::ifstream manifest(fs::path(dir) / "manifests" / sourceKey);
+    if (!manifest) return false;
+    // A hit needs every import statement to still name the same file, and
+    // every module to still hold the text that was built.
+    std::vector<ImportDigest> imports;
+    std::vector<Resolution> resolutions;
+    std::string contents;
+    for (std::string line; std::getline(manifest, line);) {
+        std::vector<std::string> fields;
+        for (size_t start = 0, end = 0; end != std::string::npos; start = end + 1) {
+            end = line.find('\t', start);
+            fields.push_back(line.substr(start, end - start));
+        }
+        if (fields[0] == "module" && fields.size() == 2) {
+            if (!readFile(fields[1], contents)) return false;
+            imports.emplace_back(fields[1], sha256(normalize(contents)));
+        } else if (fields[0] == "import" && fields.size() == 4) {
+            if (resolveImport(fields[1], fields[2]) != fields[3]) return false;
+            resolutions.push_back({fields[1], fields[2], fields[3]});
+        } else {
+            return false; // damaged, or from an older format
+        }
+    }
+    std::string key = buildKey(sourceKey, imports, resolutions);
+
+    fs::path entry = fs::path(dir) / "entries" / key;
+    try {
+        publishCopy(entry / ExecutableName, output);
+        if (!llFile.empty()) publishCopy(entry / "main.ll", llFile);
+        fs::permissions(output, fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec |
+                                    fs::perms::others_read | fs::perms::others_exec);
+        // The directory's time is its last use, for eviction.
+        fs::last_write_time(entry, fs::file_time_type::clock::now());
+    } catch (const fs::filesystem_error&) {
+        return false; // missing, or evicted under us
+    }
+    return true;
+}
+
+void BuildCache::store(const std::string& sourceKey, const std::vector<Import>& imports,
+                       std::vector<Resolution> resolutions, const std::string& llFile, const std::string& objFile,
+                       const std::string& output) {
+    std::vector<ImportDigest> sorted;
+    for (const Import& import : imports) sorted.emplace_back(import.path, sha256(normalize(import.source)));
+    std::sort(sorted.begin(), sorted.end());
+    auto fields = [](const Resolution& r) { return std::tie(r.directory, r.path, r.resolved); };
+    std::sort(resolutions.begin(), resolutions.end(),
+              [&](const Resolution& a, const Resolution& b) { return fields(a) < fields(b); });
+    resolutions.erase(std::unique(resolutions.begin(), resolutions.end(),
+                                  [&](const Resolution& a, const Resolution& b) { return fields(a) == fields(b); }),
+                      resolutions.end());
+    std::string key = buildKey(sourceKey, sorted, resolutions);
+
+    fs::path root(dir);
+    std::error_code error;
+    try {
+        fs::create_directories(root / "entries");
+        fs::create_directories(root / "manifests");
+        fs::create_directories(root / "tmp");
+
+        // Build the entry privately, then move it into place in one step.
+        // If another build already published the same key, keep theirs.
+        fs::path entry = root / "entries" / key;
+        if (!fs::exists(entry)) {
+            fs::path staging = root / "tmp" / (key + "." + uniqueSuffix());
+            fs::create_directory(staging);
+            if (!llFile.empty()) fs::copy_file(llFile, staging / "main.ll");
+            if (!objFile.empty()) fs::copy_file(objFile, staging / "main.o");
+            fs::copy_file(output, staging / ExecutableName);
+            fs::rename(staging, entry, error);
+            if (error) fs::remove_all(staging, error);
+        }
+
+        fs::path manifest = root / "tmp" / (sourceKey + "." + uniqueSuffix());
+        {
+            std::ofstream out(manifest);
+            for (const ImportDigest& import : sorted) out << "module\t" << import.first << "\n";
+            for (const Resolution& resolution : resolutions) {
+                out << "import\t" << resolution.directory << '\t' << resolution.path << '\t' << resolution.resolved
+                    << "\n";
+            }
+        }
+        fs::rename(manifest, root / "manifests" / sourceKey);
+    } catch (const fs::filesystem_error&) {
+        return;
+    }
+    evict(key);
+}
+
+// Drops least recently used entries until the cache fits its capacity.
+void BuildCache::evict(const std::string& keep) {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type used;
+        std::uintmax_t bytes;
+    };
+    std::vector<Entry> entries;
+    std::uintmax_t total = 0;
+    std::error_code error;
+    for (const auto& item : fs::directory_iterator(fs::path(dir) / "entries", error)) {
+        Entry entry{item.path(), fs::last_write_time(item.path(), error), 0};
+        for (const auto& file : fs::directory_iterator(item.path(), error)) {
+            std::uintmax_t bytes = fs::file_size(file.path(), error);
+            if (!error) entry.bytes += bytes;
+        }
+        total += entry.bytes;
+        entries.push_back(std::move(entry));
+    }
+    if (total <= capacity) return;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const Entry& entry : entries) {
+        if (total <= capacity) break;
+        if (entry.path.filename() == keep) continue;
+        fs::remove_all(entry.path, error);
+        total -= entry.bytes;
+    }
+}
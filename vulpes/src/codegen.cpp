@@ -1,10 +1,13 @@
 #include "codegen.hpp"
-#include "lexer.hpp"
+#include "fingerprint.hpp"
+#include "module_interface.hpp"
 #include "parser.hpp"
-#include "error_handler.hpp"
 
-#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
 
 namespace {
 int alignmentFor(const std::string& llvmType) {
@@ -13,7 +16,7 @@ int alignmentFor(const std::string& llvmType) {
     return 4;
 }
 
-std::string escapeString(const std::string& value) {
+std::string escapeString(std::string_view value) {
     std::string out;
     for (char c : value) {
         switch (c) {
@@ -28,16 +31,131 @@ std::string escapeString(const std::string& value) {
     out += "\\00";
     return out;
 }
+
+// Indexed by BinaryOp.
+constexpr const char* floatInstructions[] = {
+    "fcmp oeq", "fcmp one", "fcmp olt", "fcmp ole", "fcmp ogt", "fcmp oge",
+    "fadd", "fsub", "fmul", "fdiv"
+};
+constexpr const char* intInstructions[] = {
+    "icmp eq", "icmp ne", "icmp slt", "icmp sle", "icmp sgt", "icmp sge",
+    "add", "sub", "mul", "sdiv"
+};
+static_assert(std::size(floatInstructions) == static_cast<size_t>(BinaryOp::Divide) + 1);
+static_assert(std::size(intInstructions) == static_cast<size_t>(BinaryOp::Divide) + 1);
+
+// Appends every call made anywhere under the node to calls.
+void collectCalls(Expression* expr, std::vector<CallExpression*>& calls) {
+    if (!expr) return;
+    switch (expr->kind) {
+        case NodeKind::Unary:
+            collectCalls(cast<UnaryExpression>(expr)->operand, calls);
+            break;
+        case NodeKind::Binary:
+            collectCalls(cast<BinaryExpression>(expr)->left, calls);
+            collectCalls(cast<BinaryExpression>(expr)->right, calls);
+            break;
+        case NodeKind::Assignment:
+            collectCalls(cast<AssignmentExpression>(expr)->value, calls);
+            break;
+        case NodeKind::Call: {
+            auto* call = cast<CallExpression>(expr);
+            calls.push_back(call);
+            for (Expression* arg : call->arguments) collectCalls(arg, calls);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void collectCalls(Statement* stmt, std::vector<CallExpression*>& calls) {
+    if (!stmt) return;
+    switch (stmt->kind) {
+        case NodeKind::Block:
+            for (Statement* inner : cast<BlockStatement>(stmt)->statements) collectCalls(inner, calls);
+            break;
+        case NodeKind::VariableDeclaration:
+            collectCalls(cast<VariableDeclaration>(stmt)->initializer, calls);
+            break;
+        case NodeKind::AssignmentStatement:
+            collectCalls(cast<AssignmentStatement>(stmt)->value, calls);
+            break;
+        case NodeKind::ExpressionStatement:
+            collectCalls(cast<ExpressionStatement>(stmt)->expression, calls);
+            break;
+        case NodeKind::Return:
+            collectCalls(cast<ReturnStatement>(stmt)->expression, calls);
+            break;
+        case NodeKind::If: {
+            auto* ifStmt = cast<IfStatement>(stmt);
+            collectCalls(ifStmt->condition, calls);
+            collectCalls(ifStmt->thenBranch, calls);
+            collectCalls(ifStmt->elseBranch, calls);
+            break;
+        }
+        case NodeKind::For: {
+            auto* forStmt = cast<ForStatement>(stmt);
+            collectCalls(forStmt->start, calls);
+            collectCalls(forStmt->end, calls);
+            collectCalls(forStmt->body, calls);
+            break;
+        }
+        case NodeKind::While:
+            collectCalls(cast<WhileStatement>(stmt)->condition, calls);
+            collectCalls(cast<WhileStatement>(stmt)->body, calls);
+            break;
+        case NodeKind::Print:
+            for (Expression* arg : cast<PrintStatement>(stmt)->arguments) collectCalls(arg, calls);
+            break;
+        default:
+            break;
+    }
+}
+
 } // namespace
 
-CodeGenerator::CodeGenerator()
-    : tempCounter(0), strCounter(0), labelCounter(0) {}
+std::string printfFormat(std::string_view format, const std::vector<std::string>& argumentTypes) {
+    auto conversion = [](const std::string& type) {
+        if (type == "double") return "%g";
+        if (type == "i8*") return "%s";
+        return "%d";
+    };
+    std::string built(format);
+    if (built.empty() && !argumentTypes.empty()) {
+        built = "{}";
+    }
+    std::string finalFmt;
+    size_t argIndex = 0;
+    for (size_t i = 0; i < built.size(); ++i) {
+        if (built[i] == '{' && i + 1 < built.size() && built[i + 1] == '}' && argIndex < argumentTypes.size()) {
+            finalFmt += conversion(argumentTypes[argIndex]);
+            argIndex++;
+            i++;
+        } else {
+            finalFmt.push_back(built[i]);
+        }
+    }
+    while (argIndex < argumentTypes.size()) {
+        if (!finalFmt.empty() && finalFmt.back() != ' ') finalFmt += " ";
+        finalFmt += conversion(argumentTypes[argIndex]);
+        argIndex++;
+    }
+    if (finalFmt.empty() || finalFmt.back() != '\n') {
+        finalFmt.push_back('\n');
+    }
+    return finalFmt;
+}
+
+CodeGenerator::CodeGenerator(ModuleCache& moduleCache, ThreadPool* pool)
+    : moduleCache(moduleCache), pool(pool), diagnostics(&std::cerr), tempCounter(0), strCounter(0), labelCounter(0) {}
 
 std::string CodeGenerator::nextTemp() {
     return "%t" + std::to_string(++tempCounter);
 }
 
 std::string CodeGenerator::nextStringName() {
+    if (cacheFunctions) return ".str." + stringPrefix + "." + std::to_string(++strCounter);
     return ".str" + std::to_string(++strCounter);
 }
 
@@ -53,7 +171,7 @@ void CodeGenerator::popScope() {
     if (!scopes.empty()) scopes.pop_back();
 }
 
-VariableInfo* CodeGenerator::resolveVariable(const std::string& name) {
+VariableInfo* CodeGenerator::resolveVariable(Symbol name) {
     for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
         auto found = it->variables.find(name);
         if (found != it->variables.end()) return &found->second;
@@ -61,7 +179,7 @@ VariableInfo* CodeGenerator::resolveVariable(const std::string& name) {
     return nullptr;
 }
 
-std::string CodeGenerator::mapType(const std::string& type) const {
+std::string CodeGenerator::mapType(std::string_view type) const {
     if (type == "int" || type.empty()) return "i32";
     if (type == "float") return "double";
     if (type == "bool") return "i1";
@@ -70,7 +188,7 @@ std::string CodeGenerator::mapType(const std::string& type) const {
     return "i32";
 }
 
-void CodeGenerator::emitBuiltins(std::ostringstream& out) {
+void CodeGenerator::emitBuiltins(std::ostringstream& out, bool defineRuntimeState) {
     out << "; ModuleID = 'vulpes_module'\n";
     out << "target datalayout = \"e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128\"\n";
     out << "target triple = \"x86_64-pc-linux-gnu\"\n\n";
@@ -83,17 +201,23 @@ void CodeGenerator::emitBuiltins(std::ostringstream& out) {
     out << "@.str_string = private unnamed_addr constant [4 x i8] c\"%s\\0A\\00\", align 1\n";
     out << "@.str_input_int = private unnamed_addr constant [3 x i8] c\"%d\\00\", align 1\n";
     out << "@.str_input_float = private unnamed_addr constant [4 x i8] c\"%lf\\00\", align 1\n";
-    out << "@rand_seed = global i32 1, align 4\n";
-    out << "@rand_seeded = global i1 false, align 1\n\n";
+    if (defineRuntimeState) {
+        out << "@rand_seed = global i32 1, align 4\n";
+        out << "@rand_seeded = global i1 false, align 1\n\n";
+    } else {
+        out << "@rand_seed = external global i32, align 4\n";
+        out << "@rand_seeded = external global i1, align 1\n\n";
+    }
 }
 
 void CodeGenerator::emitFormatGlobals() {
     // Base globals already emitted in emitBuiltins; dynamic ones are collected in globals.
 }
 
-void CodeGenerator::registerFunction(FunctionDefinition* func) {
-    std::string key = func->ns.empty() ? func->name : func->ns + "." + func->name;
-    std::string irName = func->ns.empty() ? func->name : func->ns + "_" + func->name;
+void CodeGenerator::registerFunction(FunctionDefinition* func, Symbol scope) {
+    QualifiedName key{scope, func->name};
+    std::string irName(symbolName(func->name));
+    if (scope != NoSymbol) irName = std::string(symbolName(scope)) + "_" + irName;
     FunctionInfo info;
     info.key = key;
     info.irName = irName;
@@ -103,77 +227,183 @@ void CodeGenerator::registerFunction(FunctionDefinition* func) {
     functions[key] = info;
 }
 
-void CodeGenerator::registerImportedFunctions(const std::vector<std::unique_ptr<Statement>>& module, const std::string& ns) {
-    for (const auto& stmt : module) {
-        if (auto* func = dynamic_cast<FunctionDefinition*>(stmt.get())) {
-            func->ns = ns;
-            registerFunction(func);
+void CodeGenerator::registerImportedFunctions(const Module& module, Symbol scope) {
+    for (const auto& stmt : module.statements) {
+        if (auto* func = dyn_cast<FunctionDefinition>(stmt)) {
+            registerFunction(func, scope);
         }
     }
 }
 
-std::string CodeGenerator::generate(const std::vector<std::unique_ptr<Statement>>& statements) {
+// Unqualified names find the caller module's own functions before the root
+// file's; aliases are looked up in the caller's imports, then the root's.
+const FunctionInfo* CodeGenerator::resolveFunction(const CallExpression* call, const Module* caller) const {
+    auto lookup = [this](Symbol scope, Symbol name) -> const FunctionInfo* {
+        auto it = functions.find({scope, name});
+        return it == functions.end() ? nullptr : &it->second;
+    };
+    if (call->ns == NoSymbol) {
+        if (caller) {
+            if (const FunctionInfo* own = lookup(moduleScopes.at(caller), call->name)) return own;
+        }
+        return lookup(NoSymbol, call->name);
+    }
+    for (const Module* importer : {caller, static_cast<const Module*>(nullptr)}) {
+        auto table = aliases.find(importer);
+        if (table == aliases.end()) continue;
+        auto alias = table->second.find(call->ns);
+        if (alias != table->second.end()) return lookup(alias->second, call->name);
+    }
+    return nullptr;
+}
+
+// Loads the import graph, names every module and registers every function.
+void CodeGenerator::bind(const std::vector<Statement*>& statements) {
     tempCounter = 0;
     strCounter = 0;
     labelCounter = 0;
     functions.clear();
+    moduleScopes.clear();
+    aliases.clear();
+    currentModule = nullptr;
     scopes.clear();
     globals.str("");
     globals.clear();
+    calledFunctions.clear();
+    called.clear();
+    rootStatements = &statements;
+    graph = std::make_unique<ModuleGraph>(statements, rootPath, moduleCache, pool, *diagnostics);
 
-    // Load modules
-    struct ModulePayload {
-        std::string alias;
-        std::vector<std::unique_ptr<Statement>> nodes;
+    // Each module gets a scope symbol, also its IR name prefix: the first
+    // alias it is imported under, breadth-first from the root file, with a
+    // number appended if another module already took that name.
+    std::unordered_set<std::string> takenPrefixes;
+    std::vector<const Module*> queue;
+    auto assignScope = [&](const ModuleGraph::Import& import) {
+        if (moduleScopes.count(import.module)) return;
+        std::string prefix(symbolName(import.alias));
+        for (int n = 2; takenPrefixes.count(prefix); ++n) {
+            prefix = std::string(symbolName(import.alias)) + std::to_string(n);
+        }
+        takenPrefixes.insert(prefix);
+        moduleScopes[import.module] = intern(prefix);
+        queue.push_back(import.module);
     };
-    std::vector<ModulePayload> modules;
+    for (const auto& import : graph->rootImports()) assignScope(import);
+    for (size_t i = 0; i < queue.size(); ++i) {
+        for (const auto& import : graph->importsOf(queue[i])) assignScope(import);
+    }
+    for (const auto& import : graph->rootImports()) {
+        aliases[nullptr][import.alias] = moduleScopes[import.module];
+    }
+    for (const Module* module : queue) {
+        for (const auto& import : graph->importsOf(module)) {
+            aliases[module][import.alias] = moduleScopes[import.module];
+        }
+    }
 
+    // Register all functions, dependencies first
+    for (Module* module : graph->topologicalOrder()) {
+        registerImportedFunctions(*module, moduleScopes[module]);
+    }
     for (const auto& stmt : statements) {
-        if (auto* mod = dynamic_cast<ModuleImport*>(stmt.get())) {
-            std::ifstream file(mod->path);
-            if (!file.is_open()) {
-                continue;
-            }
-            std::stringstream buffer;
-            buffer << file.rdbuf();
-            std::string content = buffer.str();
-            Lexer lx(content);
-            ErrorHandler handler(content, mod->path);
-            Parser parser(lx.tokens, handler);
-            auto parsed = parser.parseProgram();
-            if (handler.hasErrors()) {
-                handler.printErrors();
+        if (auto* func = dyn_cast<FunctionDefinition>(stmt)) {
+            registerFunction(func, NoSymbol);
+        }
+    }
+
+    environment = 0;
+    if (cacheFunctions) {
+        // Order-independent sum over what any function's IR can depend on.
+        for (const auto& entry : functions) {
+            const FunctionInfo& info = entry.second;
+            std::string text = std::string(symbolName(info.key.ns)) + "." + std::string(symbolName(info.key.name)) +
+                               " " + info.irName + " " + info.returnType;
+            for (const Parameter& param : info.parameters) text += " " + mapType(param.type);
+            environment += fnv1a(text);
+        }
+        for (const auto& table : aliases) {
+            std::string importer = table.first ? std::string(symbolName(moduleScopes[table.first])) : "";
+            for (const auto& alias : table.second) {
+                environment += fnv1a(importer + ":" + std::string(symbolName(alias.first)) + "=" +
+                                     std::string(symbolName(alias.second)));
             }
-            modules.push_back({mod->alias, std::move(parsed)});
+        }
+    }
+}
+
+std::vector<CodeGenerator::PlannedFunction> CodeGenerator::plan(const std::vector<Statement*>& statements) {
+    bind(statements);
+
+    // Module functions are emitted only if reachable from this file's
+    // functions; their bodies are parsed the first time the walk needs them.
+    std::unordered_map<FunctionDefinition*, Module*> owners;
+    for (Module* module : graph->topologicalOrder()) {
+        for (auto& stmt : module->statements) {
+            if (auto* func = dyn_cast<FunctionDefinition>(stmt)) owners[func] = module;
+        }
+    }
+    std::unordered_set<FunctionDefinition*> reachable;
+    std::vector<FunctionDefinition*> worklist;
+    for (const auto& stmt : statements) {
+        if (auto* func = dyn_cast<FunctionDefinition>(stmt)) worklist.push_back(func);
+    }
+    std::vector<CallExpression*> calls;
+    while (!worklist.empty()) {
+        FunctionDefinition* func = worklist.back();
+        worklist.pop_back();
+        Module* owner = nullptr;
+        auto found = owners.find(func);
+        if (found != owners.end()) {
+            owner = found->second;
+            moduleCache.parseBody(*owner, func, *diagnostics);
+        }
+        calls.clear();
+        collectCalls(func->body, calls);
+        for (CallExpression* call : calls) {
+            const FunctionInfo* callee = resolveFunction(call, owner);
+            if (!callee) continue;
+            FunctionDefinition* definition = callee->definition;
+            if (owners.count(definition) && reachable.insert(definition).second) worklist.push_back(definition);
         }
     }
 
-    // Register all functions (modules first so they can be referenced)
-    for (auto& module : modules) {
-        registerImportedFunctions(module.nodes, module.alias);
+    std::vector<PlannedFunction> planned;
+    for (Module* module : graph->topologicalOrder()) {
+        Symbol scope = moduleScopes[module];
+        for (auto& stmt : module->statements) {
+            auto* func = dyn_cast<FunctionDefinition>(stmt);
+            if (func && reachable.count(func)) planned.push_back({func, &functions[{scope, func->name}], module});
+        }
     }
     for (const auto& stmt : statements) {
-        if (auto* func = dynamic_cast<FunctionDefinition*>(stmt.get())) {
-            registerFunction(func);
+        if (auto* func = dyn_cast<FunctionDefinition>(stmt)) {
+            planned.push_back({func, &functions[{NoSymbol, func->name}], nullptr});
         }
     }
+    return planned;
+}
+
+std::string CodeGenerator::generate(const std::vector<Statement*>& statements) {
+    std::vector<PlannedFunction> planned = plan(statements);
+    emittedCount = 0;
+    reusedCount = 0;
+    ++generation;
 
     std::ostringstream header;
     emitBuiltins(header);
     std::vector<std::string> functionBlocks;
 
     // Generate functions
-    for (auto& module : modules) {
-        for (auto& stmt : module.nodes) {
-            if (auto* func = dynamic_cast<FunctionDefinition*>(stmt.get())) {
-                functionBlocks.push_back(emitFunction(func, functions[func->ns + "." + func->name].irName));
-            }
-        }
+    for (const PlannedFunction& function : planned) {
+        currentModule = function.owner;
+        functionBlocks.push_back(emitFunctionCached(function.definition, function.info->irName));
     }
-    for (const auto& stmt : statements) {
-        if (auto* func = dynamic_cast<FunctionDefinition*>(stmt.get())) {
-            std::string key = func->ns.empty() ? func->name : func->ns + "." + func->name;
-            functionBlocks.push_back(emitFunction(func, functions[key].irName));
+    currentModule = nullptr;
+    if (functionCache.size() > emittedCount + reusedCount) {
+        // Forget functions that were deleted or are no longer reachable.
+        for (auto it = functionCache.begin(); it != functionCache.end();) {
+            it = it->second.generation == generation ? std::next(it) : functionCache.erase(it);
         }
     }
 
@@ -185,14 +415,198 @@ std::string CodeGenerator::generate(const std::vector<std::unique_ptr<Statement>
     for (const auto& block : functionBlocks) {
         ir << block << "\n";
     }
-    if (functions.find("main") == functions.end()) {
+    if (functions.find({NoSymbol, intern("main")}) == functions.end()) {
         ir << "define i32 @main() {\n  ret i32 0\n}\n";
     }
 
     return ir.str();
 }
 
-std::string CodeGenerator::emitFunction(FunctionDefinition* func, const std::string& irName) {
+bool CodeGenerator::generateStreaming(const std::vector<Statement*>& statements, std::string_view rootSource,
+                                      ErrorHandler& rootErrors, std::ostream& out) {
+    bind(statements);
+    emittedCount = 0;
+    reusedCount = 0;
+
+    std::unordered_map<const FunctionDefinition*, Module*> owners;
+    for (Module* module : graph->topologicalOrder()) {
+        for (auto& stmt : module->statements) {
+            if (auto* func = dyn_cast<FunctionDefinition>(stmt)) owners[func] = module;
+        }
+    }
+
+    std::ostringstream header;
+    emitBuiltins(header);
+    out << header.str();
+    // A function's string constants follow it instead of preceding every
+    // function, so nothing is held back until the end.
+    auto lower = [&](FunctionDefinition* func, const std::string& irName, const BlockStatement* funcBody) {
+        out << emitFunction(func, irName, funcBody) << "\n";
+        out << globals.str();
+        globals.str("");
+        globals.clear();
+        ++emittedCount;
+    };
+
+    // Once a body fails to parse, the rest are still parsed for their
+    // errors but no longer lowered.
+    bool ok = true;
+    for (Statement* stmt : statements) {
+        auto* func = dyn_cast<FunctionDefinition>(stmt);
+        if (!func) continue;
+        ASTContext scratch;
+        const BlockStatement* funcBody = func->body;
+        if (!funcBody && !func->deferredBody.empty()) {
+            funcBody = Parser::parseDeferredBlock(func, rootSource, rootErrors, scratch);
+        }
+        ok = ok && !rootErrors.hasErrors();
+        if (ok) lower(func, functions[{NoSymbol, func->name}].irName, funcBody);
+    }
+
+    // Module functions, in the order lowered code first calls them; a callee
+    // found while lowering one of them is appended to calledFunctions.
+    for (size_t i = 0; ok && i < calledFunctions.size(); ++i) {
+        const FunctionInfo* callee = calledFunctions[i];
+        auto owner = owners.find(callee->definition);
+        if (owner == owners.end()) continue;
+        ASTContext scratch;
+        currentModule = owner->second;
+        lower(callee->definition, callee->irName,
+              moduleCache.transientBody(*owner->second, callee->definition, scratch, *diagnostics));
+    }
+    currentModule = nullptr;
+
+    if (functions.find({NoSymbol, intern("main")}) == functions.end()) {
+        out << "define i32 @main() {\n  ret i32 0\n}\n";
+    }
+    return ok;
+}
+
+std::vector<CompilationUnit> CodeGenerator::units(const std::vector<Statement*>& statements,
+                                                  std::uint64_t rootContentHash) {
+    bind(statements);
+
+    // What callers compile against: the IR prefix and each signature.
+    auto interfaceOf = [this](const std::vector<Statement*>& decls, Symbol scope) {
+        std::string text(symbolName(scope));
+        for (Statement* stmt : decls) {
+            auto* func = dyn_cast<FunctionDefinition>(stmt);
+            if (!func) continue;
+            text += "\n";
+            text += symbolName(func->name);
+            text += " ";
+            text += mapType(func->returnType);
+            for (const Parameter& param : func->parameters) {
+                text += " ";
+                text += mapType(param.type);
+            }
+        }
+        return std::to_string(fnv1a(text));
+    };
+    std::unordered_map<const Module*, std::string> interfaces;
+    for (Module* module : graph->topologicalOrder()) {
+        interfaces[module] = interfaceOf(module->statements, moduleScopes[module]);
+    }
+    // A module also sees the root file's functions and imports.
+    std::string rootVisible = interfaceOf(statements, NoSymbol);
+    auto addImports = [&](std::string& text, const std::vector<ModuleGraph::Import>& imports) {
+        for (const auto& import : imports) {
+            text += " ";
+            text += symbolName(import.alias);
+            text += "=" + interfaces[import.module];
+        }
+    };
+    addImports(rootVisible, graph->rootImports());
+
+    std::vector<CompilationUnit> result;
+    for (Module* module : graph->topologicalOrder()) {
+        std::string prefix(symbolName(moduleScopes[module]));
+        std::string text = compilerStamp() + " module " + prefix + " " + std::to_string(module->contentHash) +
+                           " root " + rootVisible;
+        addImports(text, graph->importsOf(module));
+        result.push_back({module, "mod_" + prefix, fnv1a(text)});
+    }
+    std::string text = compilerStamp() + " root " + std::to_string(rootContentHash);
+    addImports(text, graph->rootImports());
+    result.push_back({nullptr, "root", fnv1a(text)});
+    return result;
+}
+
+std::string CodeGenerator::generateUnit(const CompilationUnit& unit) {
+    tempCounter = 0;
+    strCounter = 0;
+    labelCounter = 0;
+    globals.str("");
+    globals.clear();
+    calledFunctions.clear();
+    called.clear();
+
+    // Every function is emitted, reachable or not: other units may call it.
+    Symbol scope = unit.module ? moduleScopes.at(unit.module) : NoSymbol;
+    const std::vector<Statement*>& decls = unit.module ? unit.module->statements : *rootStatements;
+    std::vector<std::string> functionBlocks;
+    currentModule = unit.module;
+    for (Statement* stmt : decls) {
+        auto* func = dyn_cast<FunctionDefinition>(stmt);
+        if (!func) continue;
+        if (unit.module) moduleCache.parseBody(*unit.module, func, *diagnostics);
+        functionBlocks.push_back(emitFunction(func, functions[{scope, func->name}].irName, func->body));
+    }
+    currentModule = nullptr;
+
+    std::ostringstream ir;
+    emitBuiltins(ir, unit.module == nullptr);
+    for (const FunctionInfo* callee : calledFunctions) {
+        if (callee->key.ns == scope) continue;
+        ir << "declare " << callee->returnType << " @" << callee->irName << "(";
+        for (size_t i = 0; i < callee->parameters.size(); ++i) {
+            if (i > 0) ir << ", ";
+            ir << mapType(callee->parameters[i].type);
+        }
+        ir << ")\n";
+    }
+    if (!calledFunctions.empty()) ir << "\n";
+    ir << globals.str();
+    for (const auto& block : functionBlocks) {
+        ir << block << "\n";
+    }
+    if (!unit.module && functions.find({NoSymbol, intern("main")}) == functions.end()) {
+        ir << "define i32 @main() {\n  ret i32 0\n}\n";
+    }
+    return ir.str();
+}
+
+std::string CodeGenerator::emitFunctionCached(FunctionDefinition* func, const std::string& irName) {
+    if (!cacheFunctions) {
+        ++emittedCount;
+        return emitFunction(func, irName, func->body);
+    }
+    std::uint64_t shape = ModuleInterface::structuralHash(func) ^ (environment * 0x9e3779b97f4a7c15ull);
+    CachedFunction& cached = functionCache[irName];
+    cached.generation = generation;
+    if (cached.shape == shape && !cached.ir.empty()) {
+        globals << cached.globals;
+        ++reusedCount;
+        return cached.ir;
+    }
+
+    tempCounter = 0;
+    strCounter = 0;
+    labelCounter = 0;
+    stringPrefix = irName;
+    std::ostringstream outer;
+    std::swap(outer, globals);
+    cached.ir = emitFunction(func, irName, func->body);
+    cached.globals = globals.str();
+    std::swap(outer, globals);
+    globals << cached.globals;
+    cached.shape = shape;
+    ++emittedCount;
+    return cached.ir;
+}
+
+std::string CodeGenerator::emitFunction(FunctionDefinition* func, const std::string& irName,
+                                        const BlockStatement* funcBody) {
     pushScope();
     body.str("");
     body.clear();
@@ -204,7 +618,7 @@ std::string CodeGenerator::emitFunction(FunctionDefinition* func, const std::str
     for (size_t i = 0; i < func->parameters.size(); ++i) {
         if (i > 0) out << ", ";
         std::string paramType = mapType(func->parameters[i].type);
-        out << paramType << " %" << func->parameters[i].name;
+        out << paramType << " %" << symbolName(func->parameters[i].name);
     }
     out << ") {\nentry:\n";
 
@@ -214,14 +628,14 @@ std::string CodeGenerator::emitFunction(FunctionDefinition* func, const std::str
         std::string slot = nextTemp();
         int align = alignmentFor(llvmType);
         body << "  " << slot << " = alloca " << llvmType << ", align " << align << "\n";
-        body << "  store " << llvmType << " %" << param.name << ", " << llvmType << "* " << slot << ", align " << align << "\n";
+        body << "  store " << llvmType << " %" << symbolName(param.name) << ", " << llvmType << "* " << slot << ", align " << align << "\n";
         scopes.back().variables[param.name] = {slot, llvmType};
     }
 
     bool returned = false;
-    if (func->body) {
-        for (const auto& stmt : func->body->statements) {
-            returned = emitStatement(stmt.get(), retType);
+    if (funcBody) {
+        for (const auto& stmt : funcBody->statements) {
+            returned = emitStatement(stmt, retType);
             if (returned) break;
         }
     }
@@ -248,268 +662,257 @@ std::string CodeGenerator::emitFunction(FunctionDefinition* func, const std::str
 }
 
 bool CodeGenerator::emitStatement(Statement* stmt, const std::string& currentReturn) {
-    if (auto* block = dynamic_cast<BlockStatement*>(stmt)) {
-        pushScope();
-        for (const auto& s : block->statements) {
-            if (emitStatement(s.get(), currentReturn)) {
-                popScope();
-                return true;
-            }
-        }
-        popScope();
-        return false;
-    }
-
-    if (auto* decl = dynamic_cast<VariableDeclaration*>(stmt)) {
-        std::string initType = decl->type.empty() ? "" : mapType(decl->type);
-        std::string value = "0";
-        if (decl->initializer) {
-            std::string exprType;
-            value = emitExpression(decl->initializer.get(), exprType);
-            if (initType.empty()) initType = exprType;
-            else if (exprType != initType) value = convert(value, exprType, initType);
-        } else {
-            if (initType.empty()) initType = "i32";
-            if (initType == "double") value = "0.0";
-            else if (initType == "i1") value = "false";
-            else value = "0";
+    return visit(stmt, [&](auto* node) { return emit(node, currentReturn); });
+}
+
+bool CodeGenerator::emit(BlockStatement* block, const std::string& currentReturn) {
+    pushScope();
+    for (const auto& s : block->statements) {
+        if (emitStatement(s, currentReturn)) {
+            popScope();
+            return true;
         }
-        std::string slot = nextTemp();
-        int align = alignmentFor(initType);
-        body << "  " << slot << " = alloca " << initType << ", align " << align << "\n";
-        body << "  store " << initType << " " << value << ", " << initType << "* " << slot << ", align " << align << "\n";
-        scopes.back().variables[decl->name] = {slot, initType};
-        return false;
     }
+    popScope();
+    return false;
+}
 
-    if (auto* assign = dynamic_cast<AssignmentStatement*>(stmt)) {
-        auto* target = resolveVariable(assign->name);
-        if (!target) return false;
-        std::string rhsType;
-        std::string rhs = emitExpression(assign->value.get(), rhsType);
-        if (rhsType != target->type) rhs = convert(rhs, rhsType, target->type);
-        int align = alignmentFor(target->type);
-        body << "  store " << target->type << " " << rhs << ", " << target->type << "* " << target->address << ", align " << align << "\n";
-        return false;
+bool CodeGenerator::emit(VariableDeclaration* decl, const std::string&) {
+    std::string initType = decl->type.empty() ? "" : mapType(decl->type);
+    std::string value = "0";
+    if (decl->initializer) {
+        std::string exprType;
+        value = emitExpression(decl->initializer, exprType);
+        if (initType.empty()) initType = exprType;
+        else if (exprType != initType) value = convert(value, exprType, initType);
+    } else {
+        if (initType.empty()) initType = "i32";
+        if (initType == "double") value = "0.0";
+        else if (initType == "i1") value = "false";
+        else value = "0";
     }
+    std::string slot = nextTemp();
+    int align = alignmentFor(initType);
+    body << "  " << slot << " = alloca " << initType << ", align " << align << "\n";
+    body << "  store " << initType << " " << value << ", " << initType << "* " << slot << ", align " << align << "\n";
+    scopes.back().variables[decl->name] = {slot, initType};
+    return false;
+}
+
+bool CodeGenerator::emit(AssignmentStatement* assign, const std::string&) {
+    auto* target = resolveVariable(assign->name);
+    if (!target) return false;
+    std::string rhsType;
+    std::string rhs = emitExpression(assign->value, rhsType);
+    if (rhsType != target->type) rhs = convert(rhs, rhsType, target->type);
+    int align = alignmentFor(target->type);
+    body << "  store " << target->type << " " << rhs << ", " << target->type << "* " << target->address << ", align " << align << "\n";
+    return false;
+}
+
+bool CodeGenerator::emit(ExpressionStatement* exprStmt, const std::string&) {
+    std::string type;
+    emitExpression(exprStmt->expression, type);
+    return false;
+}
 
-    if (auto* exprStmt = dynamic_cast<ExpressionStatement*>(stmt)) {
+bool CodeGenerator::emit(ReturnStatement* ret, const std::string& currentReturn) {
+    if (ret->expression) {
         std::string type;
-        emitExpression(exprStmt->expression.get(), type);
-        return false;
+        std::string value = emitExpression(ret->expression, type);
+        if (type != currentReturn && currentReturn != "void") {
+            value = convert(value, type, currentReturn);
+            type = currentReturn;
+        }
+        body << "  ret " << type << " " << value << "\n";
+    } else {
+        body << "  ret void\n";
     }
+    return true;
+}
 
-    if (auto* ret = dynamic_cast<ReturnStatement*>(stmt)) {
-        if (ret->expression) {
-            std::string type;
-            std::string value = emitExpression(ret->expression.get(), type);
-            if (type != currentReturn && currentReturn != "void") {
-                value = convert(value, type, currentReturn);
-                type = currentReturn;
-            }
-            body << "  ret " << type << " " << value << "\n";
-        } else {
-            body << "  ret void\n";
-        }
-        return true;
+bool CodeGenerator::emit(PrintStatement* print, const std::string&) {
+    std::vector<std::pair<std::string, std::string>> args;
+    for (const auto& arg : print->arguments) {
+        std::string type;
+        std::string val = emitExpression(arg, type);
+        args.push_back({val, type});
     }
+    std::vector<std::string> argTypes;
+    for (const auto& arg : args) argTypes.push_back(arg.second);
+    std::string finalFmt = printfFormat(print->format, argTypes);
 
-    if (auto* print = dynamic_cast<PrintStatement*>(stmt)) {
-        std::vector<std::pair<std::string, std::string>> args;
-        for (const auto& arg : print->arguments) {
-            std::string type;
-            std::string val = emitExpression(arg.get(), type);
-            args.push_back({val, type});
-        }
-        // Determine final format string
-        std::string built = print->format;
-        if (built.empty() && !args.empty()) {
-            built = "{}";
-        }
-        std::string finalFmt;
-        size_t argIndex = 0;
-        for (size_t i = 0; i < built.size(); ++i) {
-            if (built[i] == '{' && i + 1 < built.size() && built[i + 1] == '}' && argIndex < args.size()) {
-                const auto& t = args[argIndex].second;
-                if (t == "i32") finalFmt += "%d";
-                else if (t == "double") finalFmt += "%g";
-                else if (t == "i8*") finalFmt += "%s";
-                else finalFmt += "%d";
-                argIndex++;
-                i++;
-            } else {
-                finalFmt.push_back(built[i]);
-            }
-        }
-        while (argIndex < args.size()) {
-            const auto& t = args[argIndex].second;
-            if (!finalFmt.empty() && finalFmt.back() != ' ') finalFmt += " ";
-            if (t == "i32") finalFmt += "%d";
-            else if (t == "double") finalFmt += "%g";
-            else if (t == "i8*") finalFmt += "%s";
-            else finalFmt += "%d";
-            argIndex++;
-        }
-        if (finalFmt.empty() || finalFmt.back() != '\n') {
-            finalFmt.push_back('\n');
-        }
+    std::string escaped = escapeString(finalFmt); // escapeString appends null
+    size_t length = finalFmt.size(); // includes newline
+    std::string globalName = "@" + nextStringName();
+    globals << globalName << " = private unnamed_addr constant [" << length + 1 << " x i8] c\"" << escaped << "\", align 1\n";
 
-        std::string escaped = escapeString(finalFmt); // escapeString appends null
-        size_t length = finalFmt.size(); // includes newline
-        std::string globalName = "@" + nextStringName();
-        globals << globalName << " = private unnamed_addr constant [" << length + 1 << " x i8] c\"" << escaped << "\", align 1\n";
-
-        std::string fmtPtr = nextTemp();
-        body << "  " << fmtPtr << " = getelementptr inbounds [" << length + 1 << " x i8], [" << length + 1 << " x i8]* " << globalName << ", i32 0, i32 0\n";
-        std::vector<std::pair<std::string, std::string>> convertedArgs;
-        convertedArgs.reserve(args.size());
-        for (auto& arg : args) {
-            std::string type = arg.second;
-            std::string val = arg.first;
-            if (type == "i1") {
-                val = convert(val, "i1", "i32");
-                type = "i32";
-            }
-            convertedArgs.push_back({val, type});
+    std::string fmtPtr = nextTemp();
+    body << "  " << fmtPtr << " = getelementptr inbounds [" << length + 1 << " x i8], [" << length + 1 << " x i8]* " << globalName << ", i32 0, i32 0\n";
+    std::vector<std::pair<std::string, std::string>> convertedArgs;
+    convertedArgs.reserve(args.size());
+    for (auto& arg : args) {
+        std::string type = arg.second;
+        std::string val = arg.first;
+        if (type == "i1") {
+            val = convert(val, "i1", "i32");
+            type = "i32";
         }
+        convertedArgs.push_back({val, type});
+    }
 
-        body << "  " << nextTemp() << " = call i32 (i8*, ...) @printf(i8* " << fmtPtr;
-        for (auto& arg : convertedArgs) {
-            body << ", " << arg.second << " " << arg.first;
-        }
-        body << ")\n";
-        return false;
-    }
-
-    if (auto* gather = dynamic_cast<GatherStatement*>(stmt)) {
-        for (const auto& name : gather->names) {
-            VariableInfo* var = resolveVariable(name);
-            if (!var) {
-                std::string slot = nextTemp();
-                body << "  " << slot << " = alloca i32, align 4\n";
-                body << "  store i32 0, i32* " << slot << ", align 4\n";
-                scopes.back().variables[name] = {slot, "i32"};
-                var = &scopes.back().variables[name];
-            }
-            std::string call = nextTemp();
-            body << "  " << call << " = call i32 (i8*, ...) @scanf(i8* getelementptr inbounds ([3 x i8], [3 x i8]* @.str_input_int, i32 0, i32 0), i32* " << var->address << ")\n";
+    body << "  " << nextTemp() << " = call i32 (i8*, ...) @printf(i8* " << fmtPtr;
+    for (auto& arg : convertedArgs) {
+        body << ", " << arg.second << " " << arg.first;
+    }
+    body << ")\n";
+    return false;
+}
+
+bool CodeGenerator::emit(GatherStatement* gather, const std::string&) {
+    for (Symbol name : gather->names) {
+        VariableInfo* var = resolveVariable(name);
+        if (!var) {
+            std::string slot = nextTemp();
+            body << "  " << slot << " = alloca i32, align 4\n";
+            body << "  store i32 0, i32* " << slot << ", align 4\n";
+            scopes.back().variables[name] = {slot, "i32"};
+            var = &scopes.back().variables[name];
         }
-        return false;
-    }
-
-    if (auto* ifStmt = dynamic_cast<IfStatement*>(stmt)) {
-        std::string condType;
-        std::string condVal = emitExpression(ifStmt->condition.get(), condType);
-        if (condType != "i1") condVal = convert(condVal, condType, "i1");
-        std::string thenLabel = nextLabel("if_then");
-        std::string elseLabel = nextLabel("if_else");
-        std::string endLabel = nextLabel("if_end");
-        body << "  br i1 " << condVal << ", label %" << thenLabel << ", label %" << (ifStmt->elseBranch ? elseLabel : endLabel) << "\n";
-        body << thenLabel << ":\n";
-        emitStatement(ifStmt->thenBranch.get(), currentReturn);
+        std::string call = nextTemp();
+        body << "  " << call << " = call i32 (i8*, ...) @scanf(i8* getelementptr inbounds ([3 x i8], [3 x i8]* @.str_input_int, i32 0, i32 0), i32* " << var->address << ")\n";
+    }
+    return false;
+}
+
+bool CodeGenerator::emit(IfStatement* ifStmt, const std::string& currentReturn) {
+    std::string condType;
+    std::string condVal = emitExpression(ifStmt->condition, condType);
+    if (condType != "i1") condVal = convert(condVal, condType, "i1");
+    std::string thenLabel = nextLabel("if_then");
+    std::string elseLabel = nextLabel("if_else");
+    std::string endLabel = nextLabel("if_end");
+    body << "  br i1 " << condVal << ", label %" << thenLabel << ", label %" << (ifStmt->elseBranch ? elseLabel : endLabel) << "\n";
+    body << thenLabel << ":\n";
+    emitStatement(ifStmt->thenBranch, currentReturn);
+    body << "  br label %" << endLabel << "\n";
+    if (ifStmt->elseBranch) {
+        body << elseLabel << ":\n";
+        emitStatement(ifStmt->elseBranch, currentReturn);
         body << "  br label %" << endLabel << "\n";
-        if (ifStmt->elseBranch) {
-            body << elseLabel << ":\n";
-            emitStatement(ifStmt->elseBranch.get(), currentReturn);
-            body << "  br label %" << endLabel << "\n";
-        }
-        body << endLabel << ":\n";
-        return false;
-    }
-
-    if (auto* whileStmt = dynamic_cast<WhileStatement*>(stmt)) {
-        std::string condLabel = nextLabel("while_cond");
-        std::string bodyLabel = nextLabel("while_body");
-        std::string endLabel = nextLabel("while_end");
-        body << "  br label %" << condLabel << "\n";
-        body << condLabel << ":\n";
-        std::string condType;
-        std::string condVal = emitExpression(whileStmt->condition.get(), condType);
-        if (condType != "i1") condVal = convert(condVal, condType, "i1");
-        body << "  br i1 " << condVal << ", label %" << bodyLabel << ", label %" << endLabel << "\n";
-        body << bodyLabel << ":\n";
-        emitStatement(whileStmt->body.get(), currentReturn);
-        body << "  br label %" << condLabel << "\n";
-        body << endLabel << ":\n";
-        return false;
-    }
-
-    if (auto* forStmt = dynamic_cast<ForStatement*>(stmt)) {
-        std::string startType, endType;
-        std::string startVal = emitExpression(forStmt->start.get(), startType);
-        std::string endVal = emitExpression(forStmt->end.get(), endType);
-        startVal = convert(startVal, startType, "i32");
-        endVal = convert(endVal, endType, "i32");
-
-        std::string iterSlot = nextTemp();
-        body << "  " << iterSlot << " = alloca i32, align 4\n";
-        body << "  store i32 " << startVal << ", i32* " << iterSlot << ", align 4\n";
-        scopes.back().variables[forStmt->iterator] = {iterSlot, "i32"};
-
-        std::string condLabel = nextLabel("for_cond");
-        std::string loopLabel = nextLabel("for_body");
-        std::string endLabel = nextLabel("for_end");
-
-        body << "  br label %" << condLabel << "\n";
-        body << condLabel << ":\n";
-        std::string cur = nextTemp();
-        body << "  " << cur << " = load i32, i32* " << iterSlot << ", align 4\n";
-        std::string cmp = nextTemp();
-        body << "  " << cmp << " = icmp slt i32 " << cur << ", " << endVal << "\n";
-        body << "  br i1 " << cmp << ", label %" << loopLabel << ", label %" << endLabel << "\n";
-        body << loopLabel << ":\n";
-        emitStatement(forStmt->body.get(), currentReturn);
-        std::string nextVal = nextTemp();
-        body << "  " << nextVal << " = add i32 " << cur << ", 1\n";
-        body << "  store i32 " << nextVal << ", i32* " << iterSlot << ", align 4\n";
-        body << "  br label %" << condLabel << "\n";
-        body << endLabel << ":\n";
-        return false;
     }
+    body << endLabel << ":\n";
+    return false;
+}
+
+bool CodeGenerator::emit(WhileStatement* whileStmt, const std::string& currentReturn) {
+    std::string condLabel = nextLabel("while_cond");
+    std::string bodyLabel = nextLabel("while_body");
+    std::string endLabel = nextLabel("while_end");
+    body << "  br label %" << condLabel << "\n";
+    body << condLabel << ":\n";
+    std::string condType;
+    std::string condVal = emitExpression(whileStmt->condition, condType);
+    if (condType != "i1") condVal = convert(condVal, condType, "i1");
+    body << "  br i1 " << condVal << ", label %" << bodyLabel << ", label %" << endLabel << "\n";
+    body << bodyLabel << ":\n";
+    emitStatement(whileStmt->body, currentReturn);
+    body << "  br label %" << condLabel << "\n";
+    body << endLabel << ":\n";
+    return false;
+}
+
+bool CodeGenerator::emit(ForStatement* forStmt, const std::string& currentReturn) {
+    std::string startType, endType;
+    std::string startVal = emitExpression(forStmt->start, startType);
+    std::string endVal = emitExpression(forStmt->end, endType);
+    startVal = convert(startVal, startType, "i32");
+    endVal = convert(endVal, endType, "i32");
 
+    std::string iterSlot = nextTemp();
+    body << "  " << iterSlot << " = alloca i32, align 4\n";
+    body << "  store i32 " << startVal << ", i32* " << iterSlot << ", align 4\n";
+    scopes.back().variables[forStmt->iterator] = {iterSlot, "i32"};
+
+    std::string condLabel = nextLabel("for_cond");
+    std::string loopLabel = nextLabel("for_body");
+    std::string endLabel = nextLabel("for_end");
+
+    body << "  br label %" << condLabel << "\n";
+    body << condLabel << ":\n";
+    std::string cur = nextTemp();
+    body << "  " << cur << " = load i32, i32* " << iterSlot << ", align 4\n";
+    std::string cmp = nextTemp();
+    body << "  " << cmp << " = icmp slt i32 " << cur << ", " << endVal << "\n";
+    body << "  br i1 " << cmp << ", label %" << loopLabel << ", label %" << endLabel << "\n";
+    body << loopLabel << ":\n";
+    emitStatement(forStmt->body, currentReturn);
+    std::string nextVal = nextTemp();
+    body << "  " << nextVal << " = add i32 " << cur << ", 1\n";
+    body << "  store i32 " << nextVal << ", i32* " << iterSlot << ", align 4\n";
+    body << "  br label %" << condLabel << "\n";
+    body << endLabel << ":\n";
+    return false;
+}
+
+// Nested definitions and imports are handled at module level, not here.
+bool CodeGenerator::emit(FunctionDefinition*, const std::string&) {
+    return false;
+}
+
+bool CodeGenerator::emit(ModuleImport*, const std::string&) {
     return false;
 }
 
 std::string CodeGenerator::emitExpression(Expression* expr, std::string& outType) {
-    if (auto* num = dynamic_cast<NumberExpression*>(expr)) {
+    return visit(expr, [&](auto* node) { return emit(node, outType); });
+}
+
+std::string CodeGenerator::emit(NumberExpression* num, std::string& outType) {
+    outType = "i32";
+    return std::to_string(num->value);
+}
+
+std::string CodeGenerator::emit(FloatExpression* fl, std::string& outType) {
+    outType = "double";
+    std::ostringstream oss;
+    oss << fl->value;
+    return oss.str();
+}
+
+std::string CodeGenerator::emit(StringExpression* str, std::string& outType) {
+    std::string globalName = "@" + nextStringName();
+    std::string escaped = escapeString(str->value);
+    size_t length = str->value.size() + 1;
+    globals << globalName << " = private unnamed_addr constant [" << length << " x i8] c\"" << escaped << "\", align 1\n";
+    std::string ptr = nextTemp();
+    body << "  " << ptr << " = getelementptr inbounds [" << length << " x i8], [" << length << " x i8]* " << globalName << ", i32 0, i32 0\n";
+    outType = "i8*";
+    return ptr;
+}
+
+std::string CodeGenerator::emit(BoolExpression* bl, std::string& outType) {
+    outType = "i1";
+    return bl->value ? "true" : "false";
+}
+
+std::string CodeGenerator::emit(VariableExpression* var, std::string& outType) {
+    VariableInfo* info = resolveVariable(var->name);
+    if (!info) {
         outType = "i32";
-        return std::to_string(num->value);
-    }
-    if (auto* fl = dynamic_cast<FloatExpression*>(expr)) {
-        outType = "double";
-        std::ostringstream oss;
-        oss << fl->value;
-        return oss.str();
-    }
-    if (auto* str = dynamic_cast<StringExpression*>(expr)) {
-        std::string globalName = "@" + nextStringName();
-        std::string escaped = escapeString(str->value);
-        size_t length = str->value.size() + 1;
-        globals << globalName << " = private unnamed_addr constant [" << length << " x i8] c\"" << escaped << "\", align 1\n";
-        std::string ptr = nextTemp();
-        body << "  " << ptr << " = getelementptr inbounds [" << length << " x i8], [" << length << " x i8]* " << globalName << ", i32 0, i32 0\n";
-        outType = "i8*";
-        return ptr;
-    }
-    if (auto* bl = dynamic_cast<BoolExpression*>(expr)) {
-        outType = "i1";
-        return bl->value ? "true" : "false";
-    }
-    if (auto* var = dynamic_cast<VariableExpression*>(expr)) {
-        VariableInfo* info = resolveVariable(var->name);
-        if (!info) {
-            outType = "i32";
-            return "0";
-        }
-        std::string tmp = nextTemp();
-        body << "  " << tmp << " = load " << info->type << ", " << info->type << "* " << info->address << ", align " << alignmentFor(info->type) << "\n";
-        outType = info->type;
-        return tmp;
+        return "0";
     }
-    if (auto* unary = dynamic_cast<UnaryExpression*>(expr)) {
-        std::string type;
-        std::string val = emitExpression(unary->operand.get(), type);
-        if (unary->op == "-") {
+    std::string tmp = nextTemp();
+    body << "  " << tmp << " = load " << info->type << ", " << info->type << "* " << info->address << ", align " << alignmentFor(info->type) << "\n";
+    outType = info->type;
+    return tmp;
+}
+
+std::string CodeGenerator::emit(UnaryExpression* unary, std::string& outType) {
+    std::string type;
+    std::string val = emitExpression(unary->operand, type);
+    switch (unary->op) {
+        case UnaryOp::Negate: {
             std::string tmp = nextTemp();
             if (type == "double") {
                 body << "  " << tmp << " = fsub double 0.0, " << val << "\n";
@@ -521,160 +924,131 @@ std::string CodeGenerator::emitExpression(Expression* expr, std::string& outType
             outType = type;
             return tmp;
         }
-        outType = type;
-        return val;
-    }
-    if (auto* bin = dynamic_cast<BinaryExpression*>(expr)) {
-        std::string lt, rt;
-        std::string l = emitExpression(bin->left.get(), lt);
-        std::string r = emitExpression(bin->right.get(), rt);
-
-        // comparisons
-        if (bin->op == "==" || bin->op == "!=" || bin->op == "<" || bin->op == ">" || bin->op == "<=" || bin->op == ">=") {
-            std::string cmpType = (lt == "double" || rt == "double") ? "double" : "i32";
-            if (lt != cmpType) l = convert(l, lt, cmpType);
-            if (rt != cmpType) r = convert(r, rt, cmpType);
-            std::string tmp = nextTemp();
-            if (cmpType == "double") {
-                std::string op;
-                if (bin->op == "==") op = "fcmp oeq";
-                else if (bin->op == "!=") op = "fcmp one";
-                else if (bin->op == "<") op = "fcmp olt";
-                else if (bin->op == ">") op = "fcmp ogt";
-                else if (bin->op == "<=") op = "fcmp ole";
-                else op = "fcmp oge";
-                body << "  " << tmp << " = " << op << " double " << l << ", " << r << "\n";
-            } else {
-                std::string op;
-                if (bin->op == "==") op = "icmp eq";
-                else if (bin->op == "!=") op = "icmp ne";
-                else if (bin->op == "<") op = "icmp slt";
-                else if (bin->op == ">") op = "icmp sgt";
-                else if (bin->op == "<=") op = "icmp sle";
-                else op = "icmp sge";
-                body << "  " << tmp << " = " << op << " i32 " << l << ", " << r << "\n";
-            }
-            outType = "i1";
-            return tmp;
-        }
+    }
+    outType = type;
+    return val;
+}
 
-        std::string resType = (lt == "double" || rt == "double") ? "double" : "i32";
-        if (lt != resType) l = convert(l, lt, resType);
-        if (rt != resType) r = convert(r, rt, resType);
+std::string CodeGenerator::emit(BinaryExpression* bin, std::string& outType) {
+    std::string lt, rt;
+    std::string l = emitExpression(bin->left, lt);
+    std::string r = emitExpression(bin->right, rt);
+
+    std::string opType = (lt == "double" || rt == "double") ? "double" : "i32";
+    if (lt != opType) l = convert(l, lt, opType);
+    if (rt != opType) r = convert(r, rt, opType);
+    std::string tmp = nextTemp();
+    size_t index = static_cast<size_t>(bin->op);
+    if (opType == "double") {
+        body << "  " << tmp << " = " << floatInstructions[index] << " double " << l << ", " << r << "\n";
+    } else {
+        body << "  " << tmp << " = " << intInstructions[index] << " i32 " << l << ", " << r << "\n";
+    }
+    outType = isComparison(bin->op) ? "i1" : opType;
+    return tmp;
+}
+
+std::string CodeGenerator::emit(CallExpression* call, std::string& outType) {
+    // builtins
+    static const Symbol sqrtSymbol = intern("sqrt");
+    static const Symbol randSymbol = intern("rand");
+    if (call->name == sqrtSymbol && call->arguments.size() == 1) {
+        std::string t;
+        std::string v = emitExpression(call->arguments[0], t);
+        if (t != "double") v = convert(v, t, "double");
         std::string tmp = nextTemp();
-        if (resType == "double") {
-            std::string op = bin->op == "+" ? "fadd" : bin->op == "-" ? "fsub" : bin->op == "*" ? "fmul" : "fdiv";
-            body << "  " << tmp << " = " << op << " double " << l << ", " << r << "\n";
-        } else {
-            std::string op = bin->op == "+" ? "add" : bin->op == "-" ? "sub" : bin->op == "*" ? "mul" : "sdiv";
-            body << "  " << tmp << " = " << op << " i32 " << l << ", " << r << "\n";
-        }
-        outType = resType;
+        body << "  " << tmp << " = call double @sqrt(double " << v << ")\n";
+        outType = "double";
         return tmp;
     }
-    if (auto* call = dynamic_cast<CallExpression*>(expr)) {
-        // builtins
-        if (call->name == "sqrt" && call->arguments.size() == 1) {
-            std::string t;
-            std::string v = emitExpression(call->arguments[0].get(), t);
-            if (t != "double") v = convert(v, t, "double");
-            std::string tmp = nextTemp();
-            body << "  " << tmp << " = call double @sqrt(double " << v << ")\n";
-            outType = "double";
-            return tmp;
-        }
-        if (call->name == "rand" && call->arguments.size() == 2) {
-            std::string tMin, tMax;
-            std::string minv = emitExpression(call->arguments[0].get(), tMin);
-            std::string maxv = emitExpression(call->arguments[1].get(), tMax);
-            minv = convert(minv, tMin, "i32");
-            maxv = convert(maxv, tMax, "i32");
-            std::string seeded = nextTemp();
-            std::string seedLabel = nextLabel("seed");
-            std::string contLabel = nextLabel("cont");
-            body << "  " << seeded << " = load i1, i1* @rand_seeded, align 1\n";
-            body << "  br i1 " << seeded << ", label %" << contLabel << ", label %" << seedLabel << "\n";
-            body << seedLabel << ":\n";
-            std::string timeReg = nextTemp();
-            std::string truncReg = nextTemp();
-            body << "  " << timeReg << " = call i64 @time(i8* null)\n";
-            body << "  " << truncReg << " = trunc i64 " << timeReg << " to i32\n";
-            body << "  store i32 " << truncReg << ", i32* @rand_seed, align 4\n";
-            body << "  store i1 true, i1* @rand_seeded, align 1\n";
-            body << "  br label %" << contLabel << "\n";
-            body << contLabel << ":\n";
-            std::string seed = nextTemp();
-            body << "  " << seed << " = load i32, i32* @rand_seed, align 4\n";
-            std::string s1 = nextTemp(), s2 = nextTemp(), s3 = nextTemp();
-            body << "  " << s1 << " = mul i32 " << seed << ", 1103515245\n";
-            body << "  " << s2 << " = add i32 " << s1 << ", 12345\n";
-            body << "  " << s3 << " = and i32 " << s2 << ", 2147483647\n";
-            body << "  store i32 " << s3 << ", i32* @rand_seed, align 4\n";
-            std::string range = nextTemp();
-            std::string size = nextTemp();
-            std::string scaled = nextTemp();
-            std::string result = nextTemp();
-            body << "  " << range << " = sub i32 " << maxv << ", " << minv << "\n";
-            body << "  " << size << " = add i32 " << range << ", 1\n";
-            body << "  " << scaled << " = urem i32 " << s3 << ", " << size << "\n";
-            body << "  " << result << " = add i32 " << minv << ", " << scaled << "\n";
-            outType = "i32";
-            return result;
-        }
-
-        std::string key = call->ns.empty() ? call->name : call->ns + "." + call->name;
-        auto it = functions.find(key);
-        if (it == functions.end()) {
-            outType = "i32";
-            return "0";
-        }
-        const FunctionInfo& info = it->second;
-        std::vector<std::string> argValues;
-        std::vector<std::string> argTypes;
-        for (size_t i = 0; i < call->arguments.size(); ++i) {
-            std::string t;
-            std::string v = emitExpression(call->arguments[i].get(), t);
-            if (i < info.parameters.size()) {
-                std::string expected = mapType(info.parameters[i].type);
-                if (t != expected) v = convert(v, t, expected);
-                t = expected;
-            }
-            argValues.push_back(v);
-            argTypes.push_back(t);
-        }
-        std::string res;
-        if (info.returnType != "void") {
-            res = nextTemp();
-            body << "  " << res << " = call " << info.returnType << " @" << info.irName << "(";
-        } else {
-            body << "  call void @" << info.irName << "(";
-        }
-        for (size_t i = 0; i < argValues.size(); ++i) {
-            if (i > 0) body << ", ";
-            body << argTypes[i] << " " << argValues[i];
-        }
-        body << ")\n";
-        outType = info.returnType;
-        return res;
+    if (call->name == randSymbol && call->arguments.size() == 2) {
+        std::string tMin, tMax;
+        std::string minv = emitExpression(call->arguments[0], tMin);
+        std::string maxv = emitExpression(call->arguments[1], tMax);
+        minv = convert(minv, tMin, "i32");
+        maxv = convert(maxv, tMax, "i32");
+        std::string seeded = nextTemp();
+        std::string seedLabel = nextLabel("seed");
+        std::string contLabel = nextLabel("cont");
+        body << "  " << seeded << " = load i1, i1* @rand_seeded, align 1\n";
+        body << "  br i1 " << seeded << ", label %" << contLabel << ", label %" << seedLabel << "\n";
+        body << seedLabel << ":\n";
+        std::string timeReg = nextTemp();
+        std::string truncReg = nextTemp();
+        body << "  " << timeReg << " = call i64 @time(i8* null)\n";
+        body << "  " << truncReg << " = trunc i64 " << timeReg << " to i32\n";
+        body << "  store i32 " << truncReg << ", i32* @rand_seed, align 4\n";
+        body << "  store i1 true, i1* @rand_seeded, align 1\n";
+        body << "  br label %" << contLabel << "\n";
+        body << contLabel << ":\n";
+        std::string seed = nextTemp();
+        body << "  " << seed << " = load i32, i32* @rand_seed, align 4\n";
+        std::string s1 = nextTemp(), s2 = nextTemp(), s3 = nextTemp();
+        body << "  " << s1 << " = mul i32 " << seed << ", 1103515245\n";
+        body << "  " << s2 << " = add i32 " << s1 << ", 12345\n";
+        body << "  " << s3 << " = and i32 " << s2 << ", 2147483647\n";
+        body << "  store i32 " << s3 << ", i32* @rand_seed, align 4\n";
+        std::string range = nextTemp();
+        std::string size = nextTemp();
+        std::string scaled = nextTemp();
+        std::string result = nextTemp();
+        body << "  " << range << " = sub i32 " << maxv << ", " << minv << "\n";
+        body << "  " << size << " = add i32 " << range << ", 1\n";
+        body << "  " << scaled << " = urem i32 " << s3 << ", " << size << "\n";
+        body << "  " << result << " = add i32 " << minv << ", " << scaled << "\n";
+        outType = "i32";
+        return result;
     }
 
-    if (auto* assign = dynamic_cast<AssignmentExpression*>(expr)) {
-        VariableInfo* target = resolveVariable(assign->name);
-        if (!target) {
-            outType = "i32";
-            return "0";
+    const FunctionInfo* callee = resolveFunction(call, currentModule);
+    if (!callee) {
+        outType = "i32";
+        return "0";
+    }
+    const FunctionInfo& info = *callee;
+    if (called.insert(callee).second) calledFunctions.push_back(callee);
+    std::vector<std::string> argValues;
+    std::vector<std::string> argTypes;
+    for (size_t i = 0; i < call->arguments.size(); ++i) {
+        std::string t;
+        std::string v = emitExpression(call->arguments[i], t);
+        if (i < info.parameters.size()) {
+            std::string expected = mapType(info.parameters[i].type);
+            if (t != expected) v = convert(v, t, expected);
+            t = expected;
         }
-        std::string rhsType;
-        std::string rhs = emitExpression(assign->value.get(), rhsType);
-        if (rhsType != target->type) rhs = convert(rhs, rhsType, target->type);
-        int align = alignmentFor(target->type);
-        body << "  store " << target->type << " " << rhs << ", " << target->type << "* " << target->address << ", align " << align << "\n";
-        outType = target->type;
-        return rhs;
+        argValues.push_back(v);
+        argTypes.push_back(t);
+    }
+    std::string res;
+    if (info.returnType != "void") {
+        res = nextTemp();
+        body << "  " << res << " = call " << info.returnType << " @" << info.irName << "(";
+    } else {
+        body << "  call void @" << info.irName << "(";
     }
+    for (size_t i = 0; i < argValues.size(); ++i) {
+        if (i > 0) body << ", ";
+        body << argTypes[i] << " " << argValues[i];
+    }
+    body << ")\n";
+    outType = info.returnType;
+    return res;
+}
 
-    outType = "i32";
-    return "0";
+std::string CodeGenerator::emit(AssignmentExpression* assign, std::string& outType) {
+    VariableInfo* target = resolveVariable(assign->name);
+    if (!target) {
+        outType = "i32";
+        return "0";
+    }
+    std::string rhsType;
+    std::string rhs = emitExpression(assign->value, rhsType);
+    if (rhsType != target->type) rhs = convert(rhs, rhsType, target->type);
+    int align = alignmentFor(target->type);
+    body << "  store " << target->type << " " << rhs << ", " << target->type << "* " << target->address << ", align " << align << "\n";
+    outType = target->type;
+    return rhs;
 }
 
 std::string CodeGenerator::convert(const std::string& value, const std::string& from, const std::string& to) {
@@ -0,0 +1,269 @@
+#include "daemon.hpp"
+#include "driver.hpp"
+
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <csignal>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+// Wire format, all integers in host byte order (both ends are this binary):
+//   request:  u32 count, then count strings (u32 length, bytes): the
+//             client's working directory followed by its arguments
+//   response: frames of u8 stream (1 stdout, 2 stderr) and a string, then
+//             u8 0 and the exit status as a u32
+
+namespace {
+
+constexpr std::uint8_t EndFrame = 0;
+constexpr std::uint8_t OutFrame = 1;
+constexpr std::uint8_t ErrFrame = 2;
+
+bool sendAll(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        p += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool receiveAll(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t got = ::recv(fd, p, size, 0);
+        if (got <= 0) return false;
+        p += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+bool sendString(int fd, const std::string& text) {
+    auto size = static_cast<std::uint32_t>(text.size());
+    return sendAll(fd, &size, sizeof size) && sendAll(fd, text.data(), text.size());
+}
+
+bool receiveString(int fd, std::string& text) {
+    std::uint32_t size;
+    if (!receiveAll(fd, &size, sizeof size) || size > (1u << 24)) return false;
+    text.resize(size);
+    return receiveAll(fd, &text[0], size);
+}
+
+// Whether the other end of a connected socket runs as this process's user.
+// The daemon compiles, and so reads and writes, whatever paths a request
+// names, with its own user's rights; nobody else may send it one.
+bool peerIsUs(int fd) {
+    ucred peer{};
+    socklen_t size = sizeof peer;
+    return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &size) == 0 && peer.uid == ::getuid();
+}
+
+// Creates dir, mode 0700, unless it exists; either way it must be a real
+// directory that only this user can enter, or another user could put a
+// socket of their own where clients look for the daemon.
+void makePrivateDirectory(const std::string& dir) {
+    if (::mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+        throw std::runtime_error("could not create " + dir);
+    }
+    struct stat info;
+    if (::lstat(dir.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != ::getuid() ||
+        (info.st_mode & 0077) != 0) {
+        throw std::runtime_error(dir + " is not a directory private to this user");
+    }
+}
+
+int connectTo(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof address.sun_path) return -1;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class Daemon {
+public:
+    Daemon(unsigned jobs, const std::string& moduleCacheDir) : session(true, jobs, moduleCacheDir) {}
+
+    int serve(const std::string& path);
+
+private:
+    CompilerSession session;
+    std::string socketPath;
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable idle;
+    unsigned active = 0;
+
+    void handle(int client);
+};
+
+int Daemon::serve(const std::string& path) {
+    socketPath = path;
+    int running = connectTo(socketPath);
+    if (running >= 0) {
+        ::close(running);
+        std::cerr << "Error: a daemon is already listening on " << socketPath << std::endl;
+        return 1;
+    }
+    if (socketPath == defaultSocketPath()) makePrivateDirectory(socketPath.substr(0, socketPath.find_last_of('/')));
+    ::unlink(socketPath.c_str()); // left behind by a daemon that died
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof address.sun_path) throw std::runtime_error("socket path too long: " + socketPath);
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    // Nothing can connect before listen(), so the socket is never open to
+    // others, whatever the umask.
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0 ||
+        ::chmod(socketPath.c_str(), 0600) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+        if (listener >= 0) ::close(listener);
+        throw std::runtime_error("could not listen on " + socketPath);
+    }
+    std::cerr << "vulpes daemon listening on " << socketPath << std::endl;
+
+    // Each connection gets its own thread; they share the session, whose
+    // caches are thread-safe, and its pool.
+    while (!stopping) {
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) continue;
+        if (!peerIsUs(client)) {
+            ::close(client);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++active;
+        }
+        std::thread([this, client] {
+            handle(client);
+            ::close(client);
+            std::lock_guard<std::mutex> lock(mutex);
+            --active;
+            idle.notify_all();
+        }).detach();
+        // accept() can't see the flag; the shutdown request wakes it with a
+        // connection of its own, handled like any other.
+    }
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return active == 0; });
+    return 0;
+}
+
+void Daemon::handle(int client) {
+    std::uint32_t count;
+    if (!receiveAll(client, &count, sizeof count) || count == 0 || count > 4096) return;
+    std::vector<std::string> args(count);
+    for (std::string& arg : args) {
+        if (!receiveString(client, arg)) return;
+    }
+    std::string cwd = args.front();
+    args.erase(args.begin());
+
+    std::ostringstream out, err;
+    int status = 0;
+    if (args.size() == 1 && args[0] == "--shutdown") {
+        stopping = true;
+        out << "vulpes daemon stopping\n";
+    } else {
+        try {
+            CompileOptions options = parseArguments(args);
+            options.resolvePaths(cwd);
+            options.runExec = false; // the client runs the program itself
+            status = compile(options, session, out, err);
+        } catch (const std::exception& ex) {
+            err << "Error: " << ex.what() << "\n";
+            status = 1;
+        }
+    }
+
+    std::uint8_t frame = OutFrame;
+    if (!sendAll(client, &frame, 1) || !sendString(client, out.str())) return;
+    frame = ErrFrame;
+    if (!sendAll(client, &frame, 1) || !sendString(client, err.str())) return;
+    frame = EndFrame;
+    auto code = static_cast<std::uint32_t>(status);
+    if (sendAll(client, &frame, 1)) sendAll(client, &code, sizeof code);
+
+    // Wake the accept loop so it sees the flag.
+    if (stopping) {
+        int wake = connectTo(socketPath);
+        if (wake >= 0) ::close(wake);
+    }
+}
+
+} // namespace
+
+std::string defaultSocketPath() {
+    const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime == '/') return std::string(runtime) + "/vulpes.sock";
+    return "/tmp/vulpes-" + std::to_string(::getuid()) + "/daemon.sock";
+}
+
+int runDaemon(const std::string& socketPath, unsigned jobs, const std::string& moduleCacheDir) {
+    std::signal(SIGPIPE, SIG_IGN);
+    Daemon daemon(jobs, moduleCacheDir);
+    return daemon.serve(socketPath);
+}
+
+bool runClient(const std::string& socketPath, const std::vector<std::string>& args, int& status) {
+    int fd = connectTo(socketPath);
+    if (fd < 0) return false;
+    if (!peerIsUs(fd)) {
+        // Someone else's socket; don't hand them this command line.
+        ::close(fd);
+        return false;
+    }
+
+    char cwd[PATH_MAX];
+    if (!::getcwd(cwd, sizeof cwd)) {
+        ::close(fd);
+        return false;
+    }
+    auto count = static_cast<std::uint32_t>(args.size() + 1);
+    bool sent = sendAll(fd, &count, sizeof count) && sendString(fd, cwd);
+    for (size_t i = 0; sent && i < args.size(); ++i) sent = sendString(fd, args[i]);
+
+    // A daemon that dies mid-request is reported, not silently retried:
+    // the compile may have had side effects already.
+    status = 1;
+    std::uint8_t frame;
+    std::string text;
+    while (sent && receiveAll(fd, &frame, 1)) {
+        if (frame == EndFrame) {
+            std::uint32_t code;
+            if (receiveAll(fd, &code, sizeof code)) status = static_cast<int>(code);
+            ::close(fd);
+            return true;
+        }
+        if (!receiveString(fd, text)) break;
+        (frame == ErrFrame ? std::cerr : std::cout) << text << std::flush;
+    }
+    ::close(fd);
+    std::cerr << "Error: lost connection to the vulpes daemon" << std::endl;
+    return true;
+}
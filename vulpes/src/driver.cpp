@@ -0,0 +1,396 @@
+#include "driver.hpp"
+#include "build_cache.hpp"
+#include "error_handler.hpp"
+#include "fingerprint.hpp"
+#include "parser.hpp"
+#ifdef VULPES_HAVE_LLVM
+#include "elf_linker.hpp"
+#include "llvm_backend.hpp"
+#endif
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char ManifestHeader[] = "vulpes-manifest 1";
+
+bool haveClang() {
+    static const bool found = std::system("command -v clang >/dev/null 2>&1") == 0;
+    return found;
+}
+
+bool fileExists(const std::string& path) {
+    struct stat info;
+    return ::stat(path.c_str(), &info) == 0;
+}
+
+void writeFile(const std::string& path, const std::string& content) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file || !file.write(content.data(), static_cast<std::streamsize>(content.size()))) {
+        throw std::runtime_error("could not write " + path);
+    }
+}
+
+// Unit name -> key in hex, plus the executable it was linked into.
+struct Manifest {
+    std::string output;
+    std::map<std::string, std::string> keys;
+};
+
+Manifest readManifest(const std::string& path) {
+    Manifest manifest;
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line != ManifestHeader) return manifest;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name, key;
+        if (!(fields >> name >> key)) continue;
+        if (name == "output") manifest.output = key;
+        else manifest.keys[name] = key;
+    }
+    return manifest;
+}
+
+std::string hex(std::uint64_t value) {
+    char text[17];
+    std::snprintf(text, sizeof text, "%016llx", static_cast<unsigned long long>(value));
+    return text;
+}
+
+// Publishes a finished build with what it depends on besides the root file:
+// the text each module of this compile was parsed from and the file each
+// import statement led to.
+void storeBuild(BuildCache& cache, const std::string& key, const CodeGenerator& generator,
+                const SourceManager& sources, const std::string& llFile, const std::string& objFile,
+                const std::string& output) {
+    std::vector<BuildCache::Import> imports;
+    std::vector<BuildCache::Resolution> resolutions;
+    if (const ModuleGraph* graph = generator.importGraph()) {
+        for (const Module* module : graph->topologicalOrder()) {
+            imports.push_back({module->canonicalPath, sources.buffer(module->file)});
+        }
+        for (const ModuleGraph::Resolution& resolution : graph->resolutions()) {
+            resolutions.push_back({resolution.directory, resolution.path, resolution.module->canonicalPath});
+        }
+    }
+    cache.store(key, imports, std::move(resolutions), llFile, objFile, output);
+}
+
+std::string absolute(const std::string& path, const std::string& cwd) {
+    if (path.empty() || path[0] == '/') return path;
+    return cwd + "/" + path;
+}
+
+} // namespace
+
+const char* defaultBackend() {
+#ifdef VULPES_HAVE_LLVM
+    return "llvm";
+#else
+    return "text";
+#endif
+}
+
+void CompileOptions::resolvePaths(const std::string& cwd) {
+    input = absolute(input, cwd);
+    output = absolute(output, cwd);
+    for (std::string& path : inputs) path = absolute(path, cwd);
+    batchFile = absolute(batchFile, cwd);
+    moduleCacheDir = absolute(moduleCacheDir, cwd);
+    buildDir = absolute(buildDir, cwd);
+    cacheDir = absolute(cacheDir, cwd);
+}
+
+CompileOptions parseArguments(const std::vector<std::string>& args) {
+    CompileOptions options;
+    if (const char* cacheDir = std::getenv("VULPES_CACHE_DIR")) options.cacheDir = cacheDir;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        if (arg == "--show-llvm" || arg == "-ll") options.showLLVM = true;
+        else if (arg == "--run" || arg == "-r" || arg == "run") options.runExec = true;
+        else if (arg == "--clean" || arg == "-c") options.clean = true;
+        else if (arg == "--module-stats") options.moduleStats = true;
+        else if (arg == "--watch") options.watch = true;
+        else if (arg == "--stream") options.stream = true;
+        else if (arg == "--batch") options.batch = true;
+        else if (arg == "--jit") options.jit = options.runExec = true;
+        else if (arg == "-o" && hasValue) {
+            options.output = args[++i];
+        } else if (arg == "--backend" && hasValue) {
+            options.backend = args[++i];
+            if (options.backend != "text" && options.backend != defaultBackend()) {
+                throw std::invalid_argument("backend " + options.backend + " is not built in");
+            }
+        } else if (arg == "--batch-file" && hasValue) {
+            options.batch = true;
+            options.batchFile = args[++i];
+        } else if (arg == "--build-dir" && hasValue) {
+            options.buildDir = args[++i];
+        } else if (arg == "--cache" && hasValue) {
+            options.cacheDir = args[++i];
+        } else if (arg == "--cache-size" && hasValue) {
+            options.cacheMegabytes = std::stoull(args[++i]);
+        } else if (arg == "--module-cache" && hasValue) {
+            options.moduleCacheDir = args[++i];
+        } else if ((arg == "-j" || arg == "--jobs") && hasValue) {
+            options.jobs = static_cast<unsigned>(std::stoul(args[++i]));
+        } else if (arg.size() > 4 && arg.substr(arg.size() - 4) == ".vlp") {
+            options.input = arg;
+            options.inputs.push_back(arg);
+        }
+    }
+    if (options.jit && options.backend != "llvm") throw std::invalid_argument("--jit needs the llvm backend");
+    return options;
+}
+
+CompilerSession::CompilerSession(bool trackChanges, unsigned jobs, const std::string& moduleCacheDir)
+    : sources(trackChanges), modules(sources) {
+    if (jobs != 1) pool = std::make_unique<ThreadPool>(jobs);
+    modules.setInterfaceDirectory(moduleCacheDir);
+}
+
+int compile(const CompileOptions& options, CompilerSession& session, std::ostream& out, std::ostream& err) {
+    std::string stem = options.input.substr(0, options.input.find_last_of('.'));
+    std::string llFile = stem + ".ll";
+    std::string objFile = stem + ".o";
+    auto run = [&] {
+        if (!options.runExec) return;
+        std::string cmd = "./" + options.output;
+        std::system(cmd.c_str());
+    };
+
+    // The IRBuilder backend compiles and links without files or tools, and
+    // under the JIT doesn't link at all.
+    bool jit = options.jit && options.runExec;
+    bool inProcess = options.backend == "llvm" && (jit || (!options.stream && options.buildDir.empty()));
+
+    // Backend, whole-build cache and --run, once llFile is written.
+    std::unique_ptr<BuildCache> cache;
+    std::string cacheKey;
+    auto finish = [&](const CodeGenerator& generator) -> int {
+        if (!compileObject(llFile, objFile) || !linkExecutable({objFile}, options.output)) {
+            err << "Compilation failed (clang/llc/gcc not available?).\n";
+            return 1;
+        }
+        if (cache) storeBuild(*cache, cacheKey, generator, session.sources, llFile, objFile, options.output);
+        out << "Executable created: " << options.output << std::endl;
+        run();
+        return 0;
+    };
+
+    if (options.clean) {
+        std::remove(llFile.c_str());
+        std::remove(options.output.c_str());
+        std::remove("a.out");
+        return 0;
+    }
+
+    SourceManager& sources = session.sources;
+    FileID file = sources.load(options.input);
+    if (file == InvalidFileID) throw std::runtime_error("could not open " + options.input);
+    SourceManager::Hold hold(sources, file);
+
+    // The whole-build cache covers the single-object pipeline only.
+    if (!options.cacheDir.empty() && options.buildDir.empty() && !jit) {
+        cache = std::make_unique<BuildCache>(options.cacheDir, options.cacheMegabytes << 20);
+        // In-process builds cache no IR, so --show-llvm rebuilds them.
+        cacheKey = cache->sourceKey(sources.buffer(file), sources.canonicalPath(file),
+                                    inProcess ? "in-process" : backendName());
+        if (!(inProcess && options.showLLVM) && cache->fetch(cacheKey, inProcess ? "" : llFile, options.output)) {
+            if (options.showLLVM) out << std::ifstream(llFile).rdbuf() << std::endl;
+            out << "Executable created: " << options.output << " (cached)" << std::endl;
+            run();
+            return 0;
+        }
+    }
+
+    ThreadPool* pool = session.pool.get();
+    ErrorHandler handler(sources, file);
+    ASTContext context;
+    bool streaming = options.stream && options.buildDir.empty() && !jit;
+    std::vector<Statement*> program;
+    if (streaming) {
+        // Only declarations now; bodies are parsed one at a time as they
+        // are lowered.
+        Lexer lexer(sources.buffer(file));
+        Parser parser(lexer, handler, context);
+        parser.setLazyBodies(true);
+        program = parser.parseProgram();
+    } else {
+        program = parseSource(sources.buffer(file), handler, context, pool);
+    }
+    if (handler.hasErrors()) {
+        handler.printErrors(err);
+        return 1;
+    }
+
+    ModuleCache& modules = session.modules;
+    CodeGenerator generator(modules, pool);
+    generator.setDiagnostics(err);
+    generator.setRootPath(options.input);
+    if (streaming) {
+        std::ofstream ll(llFile, std::ios::binary | std::ios::trunc);
+        if (!ll) throw std::runtime_error("could not write " + llFile);
+        bool lowered = generator.generateStreaming(program, sources.buffer(file), handler, ll);
+        if (!ll.flush()) throw std::runtime_error("could not write " + llFile);
+        if (!lowered) {
+            handler.printErrors(err);
+            return 1;
+        }
+        if (options.moduleStats) modules.printStats(err);
+        if (options.showLLVM) out << std::ifstream(llFile).rdbuf() << std::endl;
+        return finish(generator);
+    }
+    if (!options.buildDir.empty() && !jit) {
+        IncrementalResult built = buildIncrementally(generator, program, fnv1a(sources.buffer(file)),
+                                                     options.buildDir, options.output, pool);
+        if (options.moduleStats) modules.printStats(err);
+        out << "Executable " << (built.relinked ? "created" : "up to date") << ": " << options.output << " ("
+            << built.rebuilt << " of " << built.units << " units rebuilt)" << std::endl;
+        run();
+        return 0;
+    }
+#ifdef VULPES_HAVE_LLVM
+    if (inProcess) {
+        LLVMBackend backend;
+        backend.lower(generator, program, options.showLLVM);
+        if (options.moduleStats) modules.printStats(err);
+        if (options.showLLVM) out << backend.text() << std::endl;
+        if (jit) {
+            out.flush();
+            LLVMBackend::JitRun ran = backend.runJit();
+            std::ostringstream times;
+            times << std::fixed << std::setprecision(1) << "JIT compile " << ran.compileMilliseconds << " ms, run "
+                  << ran.runMilliseconds << " ms";
+            err << times.str() << std::endl;
+            return 0;
+        }
+        std::string object = backend.emitObject();
+        std::string unsupported;
+        if (!linkElfExecutable({object}, options.output, unsupported)) {
+            // Beyond the built-in linker; the system's gets the object.
+            writeFile(objFile, object);
+            if (!linkExecutable({objFile}, options.output)) {
+                err << "Linking failed (" << unsupported << ").\n";
+                return 1;
+            }
+        }
+        if (cache) storeBuild(*cache, cacheKey, generator, sources, "", "", options.output);
+        out << "Executable created: " << options.output << std::endl;
+        run();
+        return 0;
+    }
+#endif
+    std::string ir = generator.generate(program);
+    if (options.moduleStats) modules.printStats(err);
+    writeFile(llFile, ir);
+
+    if (options.showLLVM) {
+        out << ir << std::endl;
+    }
+    return finish(generator);
+}
+
+const char* backendName() {
+    return haveClang() ? "clang" : "llc+gcc";
+}
+
+bool compileObject(const std::string& llFile, const std::string& objFile) {
+    std::string cmd = haveClang() ? "clang -c -o " + objFile + " " + llFile
+                                  : "llc -relocation-model=pic -filetype=obj " + llFile + " -o " + objFile;
+    return std::system(cmd.c_str()) == 0;
+}
+
+bool linkExecutable(const std::vector<std::string>& objects, const std::string& output) {
+    std::string cmd = haveClang() ? "clang" : "gcc";
+    cmd += " -o " + output;
+    for (const std::string& object : objects) cmd += " " + object;
+    cmd += " -lm";
+    return std::system(cmd.c_str()) == 0;
+}
+
+IncrementalResult buildIncrementally(CodeGenerator& generator, const std::vector<Statement*>& program,
+                                     std::uint64_t rootContentHash, const std::string& buildDir,
+                                     const std::string& output, ThreadPool* pool) {
+    if (::mkdir(buildDir.c_str(), 0777) != 0 && errno != EEXIST) {
+        throw std::runtime_error("could not create build directory " + buildDir);
+    }
+    std::string manifestPath = buildDir + "/manifest";
+    Manifest previous = readManifest(manifestPath);
+
+    IncrementalResult result;
+    std::vector<CompilationUnit> units = generator.units(program, rootContentHash);
+    result.units = units.size();
+    std::vector<std::string> objects;
+    std::vector<std::string> stale; // .ll files whose object must be rebuilt
+    bool unitsChanged = previous.keys.size() != units.size();
+    Manifest next;
+    next.output = output;
+    for (const CompilationUnit& unit : units) {
+        std::string base = buildDir + "/" + unit.name;
+        objects.push_back(base + ".o");
+        std::string key = hex(unit.key);
+        next.keys[unit.name] = key;
+        auto known = previous.keys.find(unit.name);
+        if (known == previous.keys.end()) unitsChanged = true;
+        if (known != previous.keys.end() && known->second == key && fileExists(base + ".o")) continue;
+        writeFile(base + ".ll", generator.generateUnit(unit));
+        stale.push_back(base);
+    }
+
+    // The backend runs are independent, so they overlap on the pool.
+    std::vector<bool> compiled(stale.size());
+    if (pool && stale.size() > 1) {
+        std::vector<std::future<bool>> runs;
+        for (const std::string& base : stale) {
+            runs.push_back(pool->submit([&base] { return compileObject(base + ".ll", base + ".o"); }));
+        }
+        for (size_t i = 0; i < runs.size(); ++i) compiled[i] = runs[i].get();
+    } else {
+        for (size_t i = 0; i < stale.size(); ++i) compiled[i] = compileObject(stale[i] + ".ll", stale[i] + ".o");
+    }
+    // A failed unit is dropped from the manifest so the next build retries
+    // it; the others keep their new keys.
+    std::string failed;
+    for (size_t i = 0; i < stale.size(); ++i) {
+        if (compiled[i]) continue;
+        std::remove((stale[i] + ".o").c_str());
+        next.keys.erase(stale[i].substr(buildDir.size() + 1));
+        if (failed.empty()) failed = stale[i] + ".ll";
+    }
+    result.rebuilt = stale.size();
+
+    bool relink = !stale.empty() || unitsChanged || previous.output != output || !fileExists(output);
+    if (failed.empty() && relink) {
+        if (!linkExecutable(objects, output)) {
+            next.output.clear();
+            failed = output;
+        }
+        result.relinked = true;
+    }
+
+    std::ostringstream manifest;
+    manifest << ManifestHeader << "\n";
+    if (!next.output.empty()) manifest << "output " << next.output << "\n";
+    for (const auto& entry : next.keys) manifest << entry.first << " " << entry.second << "\n";
+    std::string temporary = manifestPath + ".tmp";
+    writeFile(temporary, manifest.str());
+    if (std::rename(temporary.c_str(), manifestPath.c_str()) != 0) {
+        throw std::runtime_error("could not write " + manifestPath);
+    }
+    if (!failed.empty()) throw std::runtime_error("could not build " + failed);
+    return result;
+}
@@ -0,0 +1,498 @@
+#include "elf_linker.hpp"
+
+#include <elf.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <gnu/libc-version.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+
+constexpr std::uint64_t BaseAddress = 0x400000;
+constexpr std::uint64_t PageSize = 0x1000;
+constexpr char Interpreter[] = "/lib64/ld-linux-x86-64.so.2";
+constexpr const char* Libraries[] = {"libc.so.6", "libm.so.6"};
+constexpr const char* StartMain = "__libc_start_main";
+constexpr unsigned ProgramHeaderCount = 6;
+
+// What crt1.o's _start does, minus the init and fini glibc 2.34 no longer
+// takes: __libc_start_main(main, argc, argv, 0, 0, rtld_fini, stack_end).
+constexpr unsigned char StartCode[] = {
+    0x31, 0xed,                   // xor %ebp, %ebp
+    0x49, 0x89, 0xd1,             // mov %rdx, %r9
+    0x5e,                         // pop %rsi
+    0x48, 0x89, 0xe2,             // mov %rsp, %rdx
+    0x48, 0x83, 0xe4, 0xf0,       // and $-16, %rsp
+    0x50,                         // push %rax
+    0x54,                         // push %rsp
+    0x45, 0x31, 0xc0,             // xor %r8d, %r8d
+    0x31, 0xc9,                   // xor %ecx, %ecx
+    0x48, 0xc7, 0xc7, 0, 0, 0, 0, // mov $main, %rdi
+    0xff, 0x15, 0, 0, 0, 0,       // call *__libc_start_main@GOT(%rip)
+    0xf4,                         // hlt
+};
+constexpr size_t StartMainField = 23;
+constexpr size_t StartCallField = 29;
+constexpr size_t StartCallEnd = 33;
+
+// jmp *symbol@GOT(%rip), padded with a two-byte nop.
+constexpr unsigned char PltCode[] = {0xff, 0x25, 0, 0, 0, 0, 0x66, 0x90};
+constexpr size_t PltSlotField = 2;
+constexpr size_t PltJumpEnd = 6;
+
+// The executables only start under glibc's dynamic loader, at its usual
+// path; anywhere else the system linker knows better.
+bool hostIsGlibc(std::string& error) {
+#if defined(__GLIBC__) && defined(__x86_64__)
+    struct stat info;
+    if (gnu_get_libc_version() && ::stat(Interpreter, &info) == 0 && S_ISREG(info.st_mode)) return true;
+    error = std::string("no glibc dynamic loader at ") + Interpreter;
+#else
+    error = "not an x86-64 glibc host";
+#endif
+    return false;
+}
+
+// A name no other process or thread is using.
+std::string uniqueSuffix() {
+    static std::atomic<unsigned> counter{0};
+    return std::to_string(::getpid()) + "." + std::to_string(counter++);
+}
+
+std::uint64_t alignUp(std::uint64_t value, std::uint64_t alignment) {
+    if (alignment <= 1) return value;
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+T read(std::string_view bytes, std::uint64_t offset) {
+    if (offset > bytes.size() || bytes.size() - offset < sizeof(T)) throw std::runtime_error("truncated object file");
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void write(std::string& image, std::uint64_t offset, const T& value) {
+    std::memcpy(&image[offset], &value, sizeof(T));
+}
+
+std::string_view stringAt(std::string_view table, std::uint32_t offset) {
+    if (offset >= table.size()) throw std::runtime_error("bad string table offset");
+    std::string_view rest = table.substr(offset);
+    return rest.substr(0, rest.find('\0'));
+}
+
+class Linker {
+public:
+    void add(std::string_view bytes);
+    std::string link();
+
+private:
+    struct Object {
+        std::string_view bytes;
+        std::vector<Elf64_Shdr> sections;
+        std::vector<Elf64_Sym> symbols;
+        std::string_view strings;
+        std::vector<int> placed; // section index -> index into Linker::sections, or -1
+    };
+    struct Section {
+        size_t object;
+        Elf64_Shdr header;
+        std::uint64_t address = 0;
+        std::uint64_t offset = 0; // in the image; unused for .bss
+    };
+    // Where a symbol reference ends up: an import, an absolute value, or an
+    // offset into one of the objects' sections.
+    struct Target {
+        int import = -1;
+        size_t object = 0;
+        std::uint16_t section = SHN_ABS;
+        std::uint64_t value = 0;
+    };
+    using DefinitionKey = std::tuple<size_t, std::uint16_t, std::uint64_t>;
+
+    std::vector<Object> objects;
+    std::vector<Section> sections;
+    std::unordered_map<std::string_view, std::pair<size_t, size_t>> globals; // name -> object, symbol
+    std::vector<std::string_view> imports;
+    std::unordered_map<std::string_view, int> importIndex;
+    std::map<DefinitionKey, size_t> definedSlots; // GOT slots after the imports'
+    std::uint64_t pltAddress = 0;
+    std::uint64_t gotAddress = 0;
+
+    Target resolve(size_t object, std::uint32_t symbol) const;
+    std::uint64_t addressOf(const Target& target) const;
+    size_t gotSlot(const Target& target) const;
+    void applyRelocations(std::string& image);
+};
+
+void Linker::add(std::string_view bytes) {
+    auto header = read<Elf64_Ehdr>(bytes, 0);
+    if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64 ||
+        header.e_ident[EI_DATA] != ELFDATA2LSB || header.e_type != ET_REL || header.e_machine != EM_X86_64) {
+        throw std::runtime_error("not an x86-64 relocatable object");
+    }
+    Object object;
+    object.bytes = bytes;
+    for (unsigned i = 0; i < header.e_shnum; ++i) {
+        object.sections.push_back(read<Elf64_Shdr>(bytes, header.e_shoff + std::uint64_t(i) * sizeof(Elf64_Shdr)));
+    }
+    if (header.e_shstrndx >= object.sections.size()) throw std::runtime_error("missing section names");
+    const Elf64_Shdr& names = object.sections[header.e_shstrndx];
+    std::string_view sectionNames = bytes.substr(names.sh_offset, names.sh_size);
+
+    size_t index = objects.size();
+    object.placed.assign(object.sections.size(), -1);
+    for (unsigned i = 0; i < object.sections.size(); ++i) {
+        const Elf64_Shdr& section = object.sections[i];
+        std::string_view name = stringAt(sectionNames, section.sh_name);
+        switch (section.sh_type) {
+            case SHT_SYMTAB: {
+                if (section.sh_link >= object.sections.size()) throw std::runtime_error("bad symbol table");
+                const Elf64_Shdr& strings = object.sections[section.sh_link];
+                object.strings = bytes.substr(strings.sh_offset, strings.sh_size);
+                for (std::uint64_t at = 0; at + sizeof(Elf64_Sym) <= section.sh_size; at += sizeof(Elf64_Sym)) {
+                    object.symbols.push_back(read<Elf64_Sym>(bytes, section.sh_offset + at));
+                }
+                continue;
+            }
+            case SHT_REL:
+            case SHT_GROUP:
+            case SHT_INIT_ARRAY:
+            case SHT_FINI_ARRAY:
+            case SHT_PREINIT_ARRAY:
+                throw std::runtime_error("unsupported section " + std::string(name));
+            default:
+                break;
+        }
+        // Unwind tables are only for debuggers and exceptions, neither of
+        // which a vulpes program has.
+        if (!(section.sh_flags & SHF_ALLOC) || section.sh_type == SHT_X86_64_UNWIND || name == ".eh_frame") continue;
+        if (section.sh_flags & SHF_TLS) throw std::runtime_error("unsupported thread-local section " + std::string(name));
+        if (section.sh_type != SHT_NOBITS && bytes.size() - std::min<std::uint64_t>(bytes.size(), section.sh_offset) < section.sh_size) {
+            throw std::runtime_error("truncated section " + std::string(name));
+        }
+        object.placed[i] = static_cast<int>(sections.size());
+        sections.push_back({index, section});
+    }
+
+    for (size_t i = 1; i < object.symbols.size(); ++i) {
+        const Elf64_Sym& symbol = object.symbols[i];
+        unsigned binding = ELF64_ST_BIND(symbol.st_info);
+        if (symbol.st_shndx == SHN_COMMON) throw std::runtime_error("unsupported common symbol");
+        if (ELF64_ST_TYPE(symbol.st_info) == STT_TLS) throw std::runtime_error("unsupported thread-local symbol");
+        if (binding == STB_LOCAL || symbol.st_shndx == SHN_UNDEF) continue;
+        std::string_view name = stringAt(object.strings, symbol.st_name);
+        auto [existing, inserted] = globals.try_emplace(name, index, i);
+        if (inserted) continue;
+        const Elf64_Sym& previous = existing->second.first == index
+                                        ? object.symbols[existing->second.second]
+                                        : objects[existing->second.first].symbols[existing->second.second];
+        bool previousWeak = ELF64_ST_BIND(previous.st_info) == STB_WEAK;
+        if (!previousWeak && binding != STB_WEAK) throw std::runtime_error("duplicate symbol " + std::string(name));
+        if (previousWeak && binding != STB_WEAK) existing->second = {index, i};
+    }
+    objects.push_back(std::move(object));
+}
+
+Linker::Target Linker::resolve(size_t object, std::uint32_t symbol) const {
+    const Object& file = objects[object];
+    if (symbol >= file.symbols.size()) throw std::runtime_error("bad symbol index");
+    const Elf64_Sym* definition = &file.symbols[symbol];
+    if (definition->st_shndx == SHN_UNDEF && symbol != 0) {
+        std::string_view name = stringAt(file.strings, definition->st_name);
+        auto global = globals.find(name);
+        if (global == globals.end()) return {importIndex.at(name)};
+        object = global->second.first;
+        definition = &objects[object].symbols[global->second.second];
+    }
+    if (definition->st_shndx == SHN_ABS || definition->st_shndx == SHN_UNDEF) return {-1, object, SHN_ABS, definition->st_value};
+    if (definition->st_shndx >= SHN_LORESERVE) throw std::runtime_error("unsupported symbol section");
+    return {-1, object, definition->st_shndx, definition->st_value};
+}
+
+std::uint64_t Linker::addressOf(const Target& target) const {
+    if (target.import >= 0) return pltAddress + std::uint64_t(target.import) * sizeof(PltCode);
+    if (target.section == SHN_ABS) return target.value;
+    int placed = objects[target.object].placed.at(target.section);
+    if (placed < 0) throw std::runtime_error("reference into a dropped section");
+    return sections[placed].address + target.value;
+}
+
+size_t Linker::gotSlot(const Target& target) const {
+    if (target.import >= 0) return static_cast<size_t>(target.import);
+    return imports.size() + definedSlots.at({target.object, target.section, target.value});
+}
+
+void Linker::applyRelocations(std::string& image) {
+    for (size_t o = 0; o < objects.size(); ++o) {
+        const Object& object = objects[o];
+        for (const Elf64_Shdr& rela : object.sections) {
+            if (rela.sh_type != SHT_RELA || rela.sh_info >= object.placed.size()) continue;
+            int placed = object.placed[rela.sh_info];
+            if (placed < 0) continue;
+            const Section& section = sections[placed];
+            for (std::uint64_t at = 0; at + sizeof(Elf64_Rela) <= rela.sh_size; at += sizeof(Elf64_Rela)) {
+                auto entry = read<Elf64_Rela>(object.bytes, rela.sh_offset + at);
+                std::uint32_t type = ELF64_R_TYPE(entry.r_info);
+                if (type == R_X86_64_NONE) continue;
+                std::uint64_t width = type == R_X86_64_64 || type == R_X86_64_PC64 ? 8 : 4;
+                if (section.header.sh_size < width || entry.r_offset > section.header.sh_size - width) {
+                    throw std::runtime_error("relocation out of range");
+                }
+                Target target = resolve(o, static_cast<std::uint32_t>(ELF64_R_SYM(entry.r_info)));
+                std::uint64_t place = section.address + entry.r_offset;
+                std::uint64_t offset = section.offset + entry.r_offset;
+                std::int64_t addend = entry.r_addend;
+                auto write32 = [&](std::int64_t value, bool isSigned) {
+                    bool fits = isSigned ? value >= INT32_MIN && value <= INT32_MAX : value >= 0 && value <= UINT32_MAX;
+                    if (!fits) throw std::runtime_error("relocation overflow");
+                    write(image, offset, static_cast<std::uint32_t>(value));
+                };
+                std::int64_t symbol = static_cast<std::int64_t>(addressOf(target));
+                switch (type) {
+                    case R_X86_64_64:
+                        write(image, offset, static_cast<std::uint64_t>(symbol + addend));
+                        break;
+                    case R_X86_64_PC64:
+                        write(image, offset, static_cast<std::uint64_t>(symbol + addend - std::int64_t(place)));
+                        break;
+                    case R_X86_64_PC32:
+                    case R_X86_64_PLT32:
+                        write32(symbol + addend - std::int64_t(place), true);
+                        break;
+                    case R_X86_64_32:
+                        write32(symbol + addend, false);
+                        break;
+                    case R_X86_64_32S:
+                        write32(symbol + addend, true);
+                        break;
+                    case R_X86_64_GOTPCREL:
+                    case R_X86_64_GOTPCRELX:
+                    case R_X86_64_REX_GOTPCRELX: {
+                        std::int64_t slot = std::int64_t(gotAddress + gotSlot(target) * 8);
+                        write32(slot + addend - std::int64_t(place), true);
+                        break;
+                    }
+                    default:
+                        throw std::runtime_error("unsupported relocation type " + std::to_string(type));
+                }
+            }
+        }
+    }
+}
+
+std::string Linker::link() {
+    // Everything referenced but not defined comes from the libraries, and
+    // needs a GOT slot the loader fills in and a PLT stub that jumps
+    // through it. Defined symbols reached through the GOT get slots of
+    // their own, filled in here.
+    auto addImport = [&](std::string_view name) {
+        if (importIndex.emplace(name, static_cast<int>(imports.size())).second) imports.push_back(name);
+    };
+    addImport(StartMain);
+    for (const Object& object : objects) {
+        for (size_t i = 1; i < object.symbols.size(); ++i) {
+            const Elf64_Sym& symbol = object.symbols[i];
+            if (symbol.st_shndx != SHN_UNDEF) continue;
+            std::string_view name = stringAt(object.strings, symbol.st_name);
+            if (!globals.count(name)) addImport(name);
+        }
+    }
+    auto main = globals.find("main");
+    if (main == globals.end()) throw std::runtime_error("no main function");
+    for (size_t o = 0; o < objects.size(); ++o) {
+        for (const Elf64_Shdr& rela : objects[o].sections) {
+            if (rela.sh_type != SHT_RELA) continue;
+            for (std::uint64_t at = 0; at + sizeof(Elf64_Rela) <= rela.sh_size; at += sizeof(Elf64_Rela)) {
+                auto entry = read<Elf64_Rela>(objects[o].bytes, rela.sh_offset + at);
+                std::uint32_t type = ELF64_R_TYPE(entry.r_info);
+                if (type != R_X86_64_GOTPCREL && type != R_X86_64_GOTPCRELX && type != R_X86_64_REX_GOTPCRELX) continue;
+                Target target = resolve(o, static_cast<std::uint32_t>(ELF64_R_SYM(entry.r_info)));
+                if (target.import < 0) definedSlots.emplace(DefinitionKey{target.object, target.section, target.value}, definedSlots.size());
+            }
+        }
+    }
+
+    // Read-only part: headers, interpreter and dynamic linking tables.
+    std::string image(sizeof(Elf64_Ehdr) + ProgramHeaderCount * sizeof(Elf64_Phdr), '\0');
+    auto align = [&](std::uint64_t alignment) { image.resize(alignUp(image.size(), alignment), '\0'); };
+    auto reserve = [&](std::uint64_t size, std::uint64_t alignment) {
+        align(alignment);
+        std::uint64_t offset = image.size();
+        image.resize(offset + size, '\0');
+        return offset;
+    };
+    std::uint64_t interpOffset = image.size();
+    image.append(Interpreter, sizeof Interpreter);
+
+    std::string dynamicStrings(1, '\0');
+    std::vector<std::uint32_t> libraryNames;
+    for (const char* library : Libraries) {
+        libraryNames.push_back(static_cast<std::uint32_t>(dynamicStrings.size()));
+        dynamicStrings.append(library).push_back('\0');
+    }
+    size_t symbolCount = imports.size() + 1;
+    std::vector<Elf64_Sym> dynamicSymbols(symbolCount);
+    for (size_t i = 0; i < imports.size(); ++i) {
+        Elf64_Sym& symbol = dynamicSymbols[i + 1];
+        symbol.st_name = static_cast<std::uint32_t>(dynamicStrings.size());
+        symbol.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+        dynamicStrings.append(imports[i]).push_back('\0');
+    }
+    // One bucket, every chain empty: the loader needs a hash table, but
+    // nothing is looked up in the executable itself.
+    std::uint64_t hashOffset = reserve((2 + 1 + symbolCount) * sizeof(std::uint32_t), 8);
+    write(image, hashOffset, std::uint32_t(1));
+    write(image, hashOffset + 4, static_cast<std::uint32_t>(symbolCount));
+    std::uint64_t symbolsOffset = reserve(symbolCount * sizeof(Elf64_Sym), 8);
+    std::memcpy(&image[symbolsOffset], dynamicSymbols.data(), symbolCount * sizeof(Elf64_Sym));
+    std::uint64_t stringsOffset = reserve(dynamicStrings.size(), 1);
+    std::memcpy(&image[stringsOffset], dynamicStrings.data(), dynamicStrings.size());
+    std::uint64_t relocationsOffset = reserve(imports.size() * sizeof(Elf64_Rela), 8);
+
+    // Code: _start, the PLT, then the objects' code and read-only data.
+    std::uint64_t startOffset = reserve(sizeof StartCode, 16);
+    std::memcpy(&image[startOffset], StartCode, sizeof StartCode);
+    std::uint64_t pltOffset = reserve(imports.size() * sizeof(PltCode), 16);
+    pltAddress = BaseAddress + pltOffset;
+    auto place = [&](bool wanted(const Elf64_Shdr&)) {
+        for (Section& section : sections) {
+            if (!wanted(section.header)) continue;
+            section.offset = reserve(section.header.sh_size, section.header.sh_addralign);
+            section.address = BaseAddress + section.offset;
+            std::memcpy(&image[section.offset], objects[section.object].bytes.data() + section.header.sh_offset,
+                        section.header.sh_size);
+        }
+    };
+    place([](const Elf64_Shdr& s) { return (s.sh_flags & SHF_EXECINSTR) && s.sh_type != SHT_NOBITS; });
+    place([](const Elf64_Shdr& s) { return !(s.sh_flags & (SHF_EXECINSTR | SHF_WRITE)) && s.sh_type != SHT_NOBITS; });
+    std::uint64_t codeEnd = image.size();
+
+    // Writable part, on pages of its own: data, the GOT, the dynamic
+    // section, then .bss past the end of the file.
+    align(PageSize);
+    std::uint64_t dataOffset = image.size();
+    place([](const Elf64_Shdr& s) { return (s.sh_flags & SHF_WRITE) && s.sh_type != SHT_NOBITS; });
+    std::uint64_t gotOffset = reserve((imports.size() + definedSlots.size()) * 8, 8);
+    gotAddress = BaseAddress + gotOffset;
+    std::vector<Elf64_Dyn> dynamic;
+    for (std::uint32_t name : libraryNames) dynamic.push_back({DT_NEEDED, {name}});
+    dynamic.push_back({DT_HASH, {BaseAddress + hashOffset}});
+    dynamic.push_back({DT_STRTAB, {BaseAddress + stringsOffset}});
+    dynamic.push_back({DT_SYMTAB, {BaseAddress + symbolsOffset}});
+    dynamic.push_back({DT_STRSZ, {dynamicStrings.size()}});
+    dynamic.push_back({DT_SYMENT, {sizeof(Elf64_Sym)}});
+    dynamic.push_back({DT_RELA, {BaseAddress + relocationsOffset}});
+    dynamic.push_back({DT_RELASZ, {imports.size() * sizeof(Elf64_Rela)}});
+    dynamic.push_back({DT_RELAENT, {sizeof(Elf64_Rela)}});
+    dynamic.push_back({DT_FLAGS, {DF_BIND_NOW}});
+    dynamic.push_back({DT_DEBUG, {0}});
+    dynamic.push_back({DT_NULL, {0}});
+    std::uint64_t dynamicOffset = reserve(dynamic.size() * sizeof(Elf64_Dyn), 8);
+    std::memcpy(&image[dynamicOffset], dynamic.data(), dynamic.size() * sizeof(Elf64_Dyn));
+    std::uint64_t fileEnd = image.size();
+    std::uint64_t memoryEnd = BaseAddress + fileEnd;
+    for (Section& section : sections) {
+        if (section.header.sh_type != SHT_NOBITS) continue;
+        section.address = alignUp(memoryEnd, section.header.sh_addralign);
+        memoryEnd = section.address + section.header.sh_size;
+    }
+
+    // Everything has an address now.
+    for (size_t i = 0; i < imports.size(); ++i) {
+        Elf64_Rela relocation{gotAddress + i * 8, ELF64_R_INFO(i + 1, R_X86_64_GLOB_DAT), 0};
+        write(image, relocationsOffset + i * sizeof(Elf64_Rela), relocation);
+        std::uint64_t stub = pltOffset + i * sizeof(PltCode);
+        std::memcpy(&image[stub], PltCode, sizeof PltCode);
+        write(image, stub + PltSlotField, static_cast<std::int32_t>(gotAddress + i * 8 - (BaseAddress + stub + PltJumpEnd)));
+    }
+    for (const auto& [key, slot] : definedSlots) {
+        Target target{-1, std::get<0>(key), std::get<1>(key), std::get<2>(key)};
+        write(image, gotOffset + (imports.size() + slot) * 8, addressOf(target));
+    }
+    std::uint64_t mainAddress = addressOf(resolve(main->second.first, static_cast<std::uint32_t>(main->second.second)));
+    if (mainAddress > INT32_MAX) throw std::runtime_error("main out of range");
+    write(image, startOffset + StartMainField, static_cast<std::uint32_t>(mainAddress));
+    write(image, startOffset + StartCallField,
+          static_cast<std::int32_t>(gotAddress + std::uint64_t(importIndex.at(StartMain)) * 8 -
+                                    (BaseAddress + startOffset + StartCallEnd)));
+    applyRelocations(image);
+
+    Elf64_Ehdr header{};
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_EXEC;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_entry = BaseAddress + startOffset;
+    header.e_phoff = sizeof(Elf64_Ehdr);
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = ProgramHeaderCount;
+    write(image, 0, header);
+
+    std::uint64_t dataAddress = BaseAddress + dataOffset;
+    std::uint64_t headersSize = ProgramHeaderCount * sizeof(Elf64_Phdr);
+    const Elf64_Phdr programHeaders[ProgramHeaderCount] = {
+        {PT_PHDR, PF_R, sizeof(Elf64_Ehdr), BaseAddress + sizeof(Elf64_Ehdr), BaseAddress + sizeof(Elf64_Ehdr),
+         headersSize, headersSize, 8},
+        {PT_INTERP, PF_R, interpOffset, BaseAddress + interpOffset, BaseAddress + interpOffset, sizeof Interpreter,
+         sizeof Interpreter, 1},
+        {PT_LOAD, PF_R | PF_X, 0, BaseAddress, BaseAddress, codeEnd, codeEnd, PageSize},
+        {PT_LOAD, PF_R | PF_W, dataOffset, dataAddress, dataAddress, fileEnd - dataOffset, memoryEnd - dataAddress,
+         PageSize},
+        {PT_DYNAMIC, PF_R | PF_W, dynamicOffset, BaseAddress + dynamicOffset, BaseAddress + dynamicOffset,
+         dynamic.size() * sizeof(Elf64_Dyn), dynamic.size() * sizeof(Elf64_Dyn), 8},
+        {PT_GNU_STACK, PF_R | PF_W, 0, 0, 0, 0, 0, 16},
+    };
+    std::memcpy(&image[sizeof(Elf64_Ehdr)], programHeaders, sizeof programHeaders);
+    return image;
+}
+
+} // namespace
+
+bool linkElfExecutable(const std::vector<std::string_view>& objects, const std::string& output, std::string& error) {
+    if (!hostIsGlibc(error)) return false;
+    std::string image;
+    try {
+        Linker linker;
+        for (std::string_view object : objects) linker.add(object);
+        image = linker.link();
+    } catch (const std::exception& ex) {
+        error = ex.what();
+        return false;
+    }
+    // Replaced in one step, so a copy that is still running keeps its file.
+    std::string temporary = output + ".tmp" + uniqueSuffix();
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(image.data(), static_cast<std::streamsize>(image.size())) || !file.flush()) {
+            error = "could not write " + temporary;
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    if (::chmod(temporary.c_str(), 0755) != 0 || std::rename(temporary.c_str(), output.c_str()) != 0) {
+        error = "could not write " + output;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -1,20 +1,22 @@
 #include "error_handler.hpp"
-#include <sstream>
 
-ErrorHandler::ErrorHandler(const std::string& sourceCode, const std::string& filename) 
-    : filename(filename) {
-    
-    // Split source code into lines for context display
-    std::stringstream ss(sourceCode);
-    std::string line;
-    while (std::getline(ss, line)) {
-        sourceLines.push_back(line);
-    }
+#include <iterator>
+
+ErrorHandler::ErrorHandler(const SourceManager& sources, FileID file)
+    : sources(sources), file(file), filename(file == InvalidFileID ? "" : sources.path(file)) {}
+
+ErrorHandler ErrorHandler::forSameFile() const {
+    return ErrorHandler(sources, file);
+}
+
+void ErrorHandler::merge(ErrorHandler&& other) {
+    errors.insert(errors.end(), std::make_move_iterator(other.errors.begin()),
+                  std::make_move_iterator(other.errors.end()));
+    other.errors.clear();
 }
 
 void ErrorHandler::addError(ErrorSeverity severity, const SourceLocation& location, const std::string& message) {
-    std::string context = getSourceLine(location.line);
-    errors.emplace_back(severity, location, message, context);
+    errors.emplace_back(severity, location, message);
 }
 
 void ErrorHandler::addError(ErrorSeverity severity, int line, int column, const std::string& message) {
@@ -67,41 +69,40 @@ size_t ErrorHandler::getErrorCount() const {
 }
 
 std::string ErrorHandler::getSourceLine(int lineNumber) const {
-    if (lineNumber > 0 && lineNumber <= static_cast<int>(sourceLines.size())) {
-        return sourceLines[lineNumber - 1]; // Convert to 0-based index
-    }
-    return "";
+    if (file == InvalidFileID) return "";
+    return std::string(sources.line(file, lineNumber));
 }
 
-void ErrorHandler::printErrors() const {
+void ErrorHandler::printErrors(std::ostream& out) const {
     for (const auto& error : errors) {
-        printError(error);
+        printError(error, out);
     }
 }
 
-void ErrorHandler::printError(const CompilerError& error) const {
-    std::cerr << severityToString(error.severity);
+void ErrorHandler::printError(const CompilerError& error, std::ostream& out) const {
+    out << severityToString(error.severity);
     
     if (!filename.empty()) {
-        std::cerr << " in " << filename;
+        out << " in " << filename;
     }
     
-    std::cerr << " at line " << error.location.line 
+    out << " at line " << error.location.line 
               << ", column " << error.location.column 
               << ": " << error.message << std::endl;
     
     // Show the source line with context
-    if (!error.context.empty()) {
-        std::cerr << "  " << error.context << std::endl;
+    std::string_view context = file == InvalidFileID ? "" : sources.line(file, error.location.line);
+    if (!context.empty()) {
+        out << "  " << context << std::endl;
         
         // Show a caret pointing to the error location
-        std::cerr << "  ";
+        out << "  ";
         for (int i = 1; i < error.location.column; i++) {
-            std::cerr << " ";
+            out << " ";
         }
-        std::cerr << "^" << std::endl;
+        out << "^" << std::endl;
     }
-    std::cerr << std::endl;
+    out << std::endl;
 }
 
 std::string ErrorHandler::severityToString(ErrorSeverity severity) const {
@@ -1,211 +1,348 @@
 #include "lexer.hpp"
-#include <cctype>
+#include "scan.hpp"
+
+#include <cstring>
 
 namespace {
-bool isIdentifierStart(char c) {
-    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+struct Keyword {
+    std::string_view spelling;
+    TokenType type;
+};
+
+constexpr Keyword keywords[] = {
+#define VULPES_KEYWORD_ENTRY(type, spelling) {spelling, TokenType::type},
+    VULPES_KEYWORDS(VULPES_KEYWORD_ENTRY)
+#undef VULPES_KEYWORD_ENTRY
+};
+
+// Keywords are classified with a perfect hash over (length, first, last
+// character): one table probe and one compare reject any identifier.
+constexpr size_t keywordTableSize = 32; // power of two
+
+constexpr size_t keywordHash(std::string_view word, unsigned multiplier) {
+    return (word.size() + static_cast<unsigned char>(word.front()) * multiplier +
+            static_cast<unsigned char>(word.back())) & (keywordTableSize - 1);
 }
 
-bool isIdentifierPart(char c) {
-    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+constexpr unsigned findKeywordMultiplier() {
+    for (unsigned multiplier = 1; multiplier < 256; ++multiplier) {
+        bool used[keywordTableSize] = {};
+        bool collision = false;
+        for (const auto& keyword : keywords) {
+            size_t slot = keywordHash(keyword.spelling, multiplier);
+            if (used[slot]) {
+                collision = true;
+                break;
+            }
+            used[slot] = true;
+        }
+        if (!collision) return multiplier;
+    }
+    return 0;
+}
+
+constexpr unsigned keywordMultiplier = findKeywordMultiplier();
+static_assert(keywordMultiplier != 0, "keyword list needs a larger keywordTableSize");
+
+struct KeywordTable {
+    Keyword slots[keywordTableSize]; // empty slots have an empty spelling
+};
+
+constexpr KeywordTable buildKeywordTable() {
+    KeywordTable table{};
+    for (const auto& keyword : keywords) {
+        table.slots[keywordHash(keyword.spelling, keywordMultiplier)] = keyword;
+    }
+    return table;
+}
+
+constexpr KeywordTable keywordTable = buildKeywordTable();
+
+TokenType classifyWord(std::string_view word) {
+    const Keyword& slot = keywordTable.slots[keywordHash(word, keywordMultiplier)];
+    if (slot.spelling.size() != word.size() ||
+        std::memcmp(slot.spelling.data(), word.data(), word.size()) != 0) {
+        return TokenType::Identifier;
+    }
+    return slot.type;
 }
 } // namespace
 
-Lexer::Lexer(const std::string& source) {
-    size_t i = 0;
-    int line = 1;
-    int col = 1;
-
-    auto bump = [&](char c) {
-        if (c == '\n') {
-            line++;
-            col = 1;
-        } else {
-            col++;
+Lexer::Lexer(std::string_view source)
+    : cursor(source.data()),
+      end(source.data() + source.size()),
+      lineStart(source.data()),
+      line(1) {}
+
+Lexer::Lexer(std::string_view source, SourceOffset begin, size_t stop)
+    : cursor(source.data() + begin.offset),
+      end(source.data() + stop),
+      lineStart(source.data()),
+      line(begin.line) {
+    for (const char* p = cursor; p > source.data(); --p) {
+        if (p[-1] == '\n') {
+            lineStart = p;
+            break;
+        }
+    }
+}
+
+const char* Lexer::skipBlock(int depth) {
+    bool interning = internIdentifiers;
+    internIdentifiers = false;
+    const char* closed = nullptr;
+    for (Token token = next(); token.type != TokenType::EndOfFile; token = next()) {
+        if (token.type == TokenType::LeftBrace) {
+            ++depth;
+        } else if (token.type == TokenType::RightBrace && --depth == 0) {
+            closed = cursor;
+            break;
         }
+    }
+    internIdentifiers = interning;
+    return closed;
+}
+
+std::vector<SourceOffset> Lexer::topLevelFunctions(std::string_view source) {
+    Lexer lexer(source);
+    lexer.internIdentifiers = false;
+    std::vector<SourceOffset> starts;
+    int depth = 0;
+    for (Token token = lexer.next(); token.type != TokenType::EndOfFile; token = lexer.next()) {
+        switch (token.type) {
+            case TokenType::LeftBrace:
+                ++depth;
+                break;
+            case TokenType::RightBrace:
+                // the parser reports and skips stray closing braces
+                if (depth > 0) --depth;
+                break;
+            case TokenType::Fx:
+                if (depth == 0) {
+                    starts.push_back({static_cast<size_t>(token.lexeme.data() - source.data()), token.line});
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return starts;
+}
+
+// Columns are byte offsets from the start of the current line.
+int Lexer::column(const char* at) const {
+    return static_cast<int>(at - lineStart) + 1;
+}
+
+Token Lexer::make(TokenType type, std::string_view lexeme, const char* at, Symbol symbol) const {
+    return {type, lexeme, line, column(at), symbol};
+}
+
+Token Lexer::next() {
+    const char*& p = cursor;
+    auto view = [](const char* from, const char* to) {
+        return std::string_view(from, static_cast<size_t>(to - from));
     };
 
-    while (i < source.size()) {
-        char c = source[i];
+    while (p < end) {
+        char c = *p;
 
-        if (std::isspace(static_cast<unsigned char>(c))) {
-            bump(c);
-            i++;
+        if (scan::isWhitespace(static_cast<unsigned char>(c))) {
+            int newlines = 0;
+            const char* lastNewline = nullptr;
+            p = scan::skipWhitespace(p, end, newlines, lastNewline);
+            if (newlines > 0) {
+                line += newlines;
+                lineStart = lastNewline + 1;
+            }
             continue;
         }
 
         // line comments //
-        if (c == '/' && i + 1 < source.size() && source[i + 1] == '/') {
-            while (i < source.size() && source[i] != '\n') {
-                bump(source[i]);
-                i++;
-            }
+        if (c == '/' && p + 1 < end && p[1] == '/') {
+            p = scan::findLineEnd(p + 2, end);
             continue;
         }
 
         // string literal
         if (c == '"') {
-            size_t start = i + 1;
-            int startCol = col;
-            i++;
-            col++;
-            std::string value;
-            while (i < source.size() && source[i] != '"') {
-                if (source[i] == '\\' && i + 1 < source.size()) {
-                    char esc = source[i + 1];
-                    if (esc == 'n') value.push_back('\n');
-                    else if (esc == 't') value.push_back('\t');
-                    else value.push_back(esc);
-                    bump(source[i]);
-                    bump(source[i + 1]);
-                    i += 2;
-                } else {
-                    value.push_back(source[i]);
-                    bump(source[i]);
-                    i++;
+            Token token = make(TokenType::String, {}, p);
+            const char* start = ++p;
+            bool escaped = false;
+            while (true) {
+                p = scan::findStringStop(p, end);
+                if (p >= end || *p == '"') break;
+                if (*p == '\\' && p + 1 < end) {
+                    escaped = true;
+                    p++;
                 }
+                if (*p == '\n') {
+                    line++;
+                    lineStart = p + 1;
+                }
+                p++;
             }
-            if (i < source.size() && source[i] == '"') {
-                i++;
-                col++;
+            token.lexeme = view(start, p);
+            if (escaped) {
+                // only literals with escapes need their own storage
+                std::string& unescaped = literals.emplace_back();
+                unescaped.reserve(token.lexeme.size());
+                for (size_t j = 0; j < token.lexeme.size(); ++j) {
+                    if (token.lexeme[j] == '\\' && j + 1 < token.lexeme.size()) {
+                        char esc = token.lexeme[++j];
+                        if (esc == 'n') unescaped.push_back('\n');
+                        else if (esc == 't') unescaped.push_back('\t');
+                        else unescaped.push_back(esc);
+                    } else {
+                        unescaped.push_back(token.lexeme[j]);
+                    }
+                }
+                token.lexeme = unescaped;
             }
-            add(TokenType::String, value, line, startCol);
-            continue;
+            if (p < end && *p == '"') p++;
+            return token;
         }
 
         // numbers
-        if (std::isdigit(static_cast<unsigned char>(c))) {
-            int startCol = col;
-            size_t start = i;
+        if (scan::isDigit(static_cast<unsigned char>(c))) {
+            const char* start = p;
             bool hasDot = false;
-            while (i < source.size() &&
-                   (std::isdigit(static_cast<unsigned char>(source[i])) || source[i] == '.')) {
-                if (source[i] == '.') {
+            while (p < end && (scan::isDigit(static_cast<unsigned char>(*p)) || *p == '.')) {
+                if (*p == '.') {
                     if (hasDot) break;
-                    if (i + 1 < source.size() && source[i + 1] == '.') break;
+                    if (p + 1 < end && p[1] == '.') break;
                     hasDot = true;
                 }
-                bump(source[i]);
-                i++;
+                p++;
             }
-            std::string num = source.substr(start, i - start);
-            add(hasDot ? TokenType::Float : TokenType::Number, num, line, startCol);
-            continue;
+            return make(hasDot ? TokenType::Float : TokenType::Number, view(start, p), start);
         }
 
         // identifiers/keywords
-        if (isIdentifierStart(c)) {
-            int startCol = col;
-            size_t start = i;
-            while (i < source.size() && isIdentifierPart(source[i])) {
-                bump(source[i]);
-                i++;
-            }
-            std::string word = source.substr(start, i - start);
-            TokenType type = TokenType::Identifier;
-            if (word == "var") type = TokenType::Var;
-            else if (word == "const") type = TokenType::Const;
-            else if (word == "fx") type = TokenType::Fx;
-            else if (word == "if") type = TokenType::If;
-            else if (word == "else") type = TokenType::Else;
-            else if (word == "for") type = TokenType::For;
-            else if (word == "in") type = TokenType::In;
-            else if (word == "while") type = TokenType::While;
-            else if (word == "return") type = TokenType::Return;
-            else if (word == "print") type = TokenType::Print;
-            else if (word == "gather") type = TokenType::Gather;
-            else if (word == "mod") type = TokenType::Mod;
-            else if (word == "true") type = TokenType::True;
-            else if (word == "false") type = TokenType::False;
-            add(type, word, line, startCol);
-            continue;
+        if (scan::isIdentifierStart(static_cast<unsigned char>(c))) {
+            const char* start = p;
+            p = scan::skipIdentifier(p + 1, end);
+            std::string_view word = view(start, p);
+            TokenType type = classifyWord(word);
+            return make(type, word, start, type == TokenType::Identifier && internIdentifiers ? intern(word) : NoSymbol);
         }
 
         // punctuation/operators
+        const char* start = p;
+        char next = p + 1 < end ? p[1] : '\0';
         switch (c) {
-            case '+': add(TokenType::Plus, "+", line, col); bump(c); i++; break;
+            case '+': p++; return make(TokenType::Plus, view(start, p), start);
             case '-':
-                if (i + 1 < source.size() && source[i + 1] == '>') {
-                    add(TokenType::Arrow, "->", line, col);
-                    bump(c); bump(source[i + 1]); i += 2;
-                } else {
-                    add(TokenType::Minus, "-", line, col);
-                    bump(c); i++;
+                if (next == '>') {
+                    p += 2;
+                    return make(TokenType::Arrow, view(start, p), start);
                 }
-                break;
-            case '*': add(TokenType::Star, "*", line, col); bump(c); i++; break;
-            case '/': add(TokenType::Slash, "/", line, col); bump(c); i++; break;
-            case '(': add(TokenType::LeftParen, "(", line, col); bump(c); i++; break;
-            case ')': add(TokenType::RightParen, ")", line, col); bump(c); i++; break;
-            case '{': add(TokenType::LeftBrace, "{", line, col); bump(c); i++; break;
-            case '}': add(TokenType::RightBrace, "}", line, col); bump(c); i++; break;
-            case ',': add(TokenType::Comma, ",", line, col); bump(c); i++; break;
-            case ';': add(TokenType::Semicolon, ";", line, col); bump(c); i++; break;
+                p++;
+                return make(TokenType::Minus, view(start, p), start);
+            case '*': p++; return make(TokenType::Star, view(start, p), start);
+            case '/': p++; return make(TokenType::Slash, view(start, p), start);
+            case '(': p++; return make(TokenType::LeftParen, view(start, p), start);
+            case ')': p++; return make(TokenType::RightParen, view(start, p), start);
+            case '{': p++; return make(TokenType::LeftBrace, view(start, p), start);
+            case '}': p++; return make(TokenType::RightBrace, view(start, p), start);
+            case ',': p++; return make(TokenType::Comma, view(start, p), start);
+            case ';': p++; return make(TokenType::Semicolon, view(start, p), start);
             case ':':
-                if (i + 1 < source.size() && source[i + 1] == ':') {
-                    add(TokenType::ColonColon, "::", line, col);
-                    bump(c); bump(source[i + 1]); i += 2;
-                } else {
-                    add(TokenType::Colon, ":", line, col);
-                    bump(c); i++;
+                if (next == ':') {
+                    p += 2;
+                    return make(TokenType::ColonColon, view(start, p), start);
                 }
-                break;
+                p++;
+                return make(TokenType::Colon, view(start, p), start);
             case '.':
-                if (i + 1 < source.size() && source[i + 1] == '.') {
-                    add(TokenType::DotDot, "..", line, col);
-                    bump(c); bump(source[i + 1]); i += 2;
-                } else {
-                    add(TokenType::Dot, ".", line, col);
-                    bump(c); i++;
+                if (next == '.') {
+                    p += 2;
+                    return make(TokenType::DotDot, view(start, p), start);
                 }
-                break;
+                p++;
+                return make(TokenType::Dot, view(start, p), start);
             case '=':
-                if (i + 1 < source.size() && source[i + 1] == '=') {
-                    add(TokenType::Equals, "==", line, col);
-                    bump(c); bump(source[i + 1]); i += 2;
-                } else {
-                    add(TokenType::Assign, "=", line, col);
-                    bump(c); i++;
+                if (next == '=') {
+                    p += 2;
+                    return make(TokenType::Equals, view(start, p), start);
                 }
-                break;
+                p++;
+                return make(TokenType::Assign, view(start, p), start);
             case '!':
-                if (i + 1 < source.size() && source[i + 1] == '=') {
-                    add(TokenType::NotEquals, "!=", line, col);
-                    bump(c); bump(source[i + 1]); i += 2;
-                } else {
-                    add(TokenType::Unknown, "!", line, col);
-                    bump(c); i++;
+                if (next == '=') {
+                    p += 2;
+                    return make(TokenType::NotEquals, view(start, p), start);
                 }
-                break;
+                p++;
+                return make(TokenType::Unknown, view(start, p), start);
             case '<':
-                if (i + 1 < source.size() && source[i + 1] == '=') {
-                    add(TokenType::LessEq, "<=", line, col);
-                    bump(c); bump(source[i + 1]); i += 2;
-                } else {
-                    add(TokenType::Less, "<", line, col);
-                    bump(c); i++;
+                if (next == '=') {
+                    p += 2;
+                    return make(TokenType::LessEq, view(start, p), start);
                 }
-                break;
+                p++;
+                return make(TokenType::Less, view(start, p), start);
             case '>':
-                if (i + 1 < source.size() && source[i + 1] == '=') {
-                    add(TokenType::GreaterEq, ">=", line, col);
-                    bump(c); bump(source[i + 1]); i += 2;
-                } else {
-                    add(TokenType::Greater, ">", line, col);
-                    bump(c); i++;
+                if (next == '=') {
+                    p += 2;
+                    return make(TokenType::GreaterEq, view(start, p), start);
                 }
-                break;
+                p++;
+                return make(TokenType::Greater, view(start, p), start);
             default:
-                add(TokenType::Unknown, std::string(1, c), line, col);
-                bump(c);
-                i++;
-                break;
+                p++;
+                return make(TokenType::Unknown, view(start, p), start);
         }
     }
 
-    add(TokenType::EndOfFile, "", line, col);
+    return make(TokenType::EndOfFile, "", p);
 }
 
-void Lexer::add(TokenType type, const std::string& lexeme, int line, int column) {
-    tokens.push_back({type, lexeme, line, column});
+TokenStream::TokenStream(Lexer& lexer)
+    : lexer(lexer), head(0), count(1) {
+    ring[0] = lexer.next();
+}
+
+const Token& TokenStream::current() const {
+    return ring[head];
+}
+
+const Token& TokenStream::peek(size_t distance) {
+    while (count <= distance) {
+        ring[(head + count) & (Lookahead - 1)] = lexer.next();
+        count++;
+    }
+    return ring[(head + distance) & (Lookahead - 1)];
+}
+
+const char* TokenStream::skipBlock() {
+    int depth = 0;
+    while (true) {
+        const Token& token = ring[head];
+        if (token.type == TokenType::EndOfFile) return nullptr;
+        if (token.type == TokenType::LeftBrace) {
+            ++depth;
+        } else if (token.type == TokenType::RightBrace && --depth == 0) {
+            const char* closed = token.lexeme.data() + 1;
+            advance();
+            return closed;
+        }
+        if (count == 1) {
+            // Nothing buffered past here; the lexer skims the rest.
+            const char* closed = lexer.skipBlock(depth);
+            ring[head] = lexer.next();
+            return closed;
+        }
+        advance();
+    }
+}
+
+void TokenStream::advance() {
+    if (ring[head].type == TokenType::EndOfFile) return;
+    head = (head + 1) & (Lookahead - 1);
+    count--;
+    if (count == 0) {
+        ring[head] = lexer.next();
+        count = 1;
+    }
 }
@@ -0,0 +1,607 @@
+#include "llvm_backend.hpp"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+struct LLVMBackend::State {
+    std::unique_ptr<llvm::LLVMContext> context; // handed to the JIT with the module
+    std::unique_ptr<llvm::TargetMachine> target;
+    std::unique_ptr<llvm::Module> module;
+};
+
+namespace {
+
+struct Variable {
+    llvm::AllocaInst* address;
+    llvm::Type* type;
+};
+
+// One module's worth of lowering. Mirrors CodeGenerator's textual emitters
+// node for node, so both backends accept and miscompile the same programs.
+class Lowering {
+public:
+    Lowering(CodeGenerator& frontend, llvm::Module& module)
+        : frontend(frontend), module(module), context(module.getContext()), builder(context) {}
+
+    void declare(const CodeGenerator::PlannedFunction& planned);
+    void define(const CodeGenerator::PlannedFunction& planned);
+    void defineMainStub();
+
+private:
+    CodeGenerator& frontend;
+    llvm::Module& module;
+    llvm::LLVMContext& context;
+    llvm::IRBuilder<> builder;
+    llvm::Function* function = nullptr;
+    const Module* owner = nullptr; // of the function being lowered
+    std::vector<std::unordered_map<Symbol, Variable>> scopes;
+    llvm::Constant* inputFormat = nullptr;
+
+    llvm::Type* typeOf(std::string_view vulpesType);
+    llvm::FunctionType* signature(const FunctionInfo& info);
+    llvm::FunctionCallee runtime(const char* name);
+    llvm::GlobalVariable* runtimeState(const char* name, llvm::Constant* initial);
+    llvm::AllocaInst* allocate(llvm::Type* type, Symbol name);
+    Variable* resolve(Symbol name);
+    bool terminated() { return builder.GetInsertBlock()->getTerminator() != nullptr; }
+    llvm::Value* convert(llvm::Value* value, llvm::Type* to);
+
+    bool lowerStatement(Statement* stmt, llvm::Type* returnType);
+    llvm::Value* lowerExpression(Expression* expr);
+
+    // Per-node lowering reached through visit(); statements return true
+    // when they terminate the current block.
+    bool lower(BlockStatement* block, llvm::Type* returnType);
+    bool lower(VariableDeclaration* decl, llvm::Type* returnType);
+    bool lower(AssignmentStatement* assign, llvm::Type* returnType);
+    bool lower(ExpressionStatement* exprStmt, llvm::Type* returnType);
+    bool lower(ReturnStatement* ret, llvm::Type* returnType);
+    bool lower(PrintStatement* print, llvm::Type* returnType);
+    bool lower(GatherStatement* gather, llvm::Type* returnType);
+    bool lower(IfStatement* ifStmt, llvm::Type* returnType);
+    bool lower(WhileStatement* whileStmt, llvm::Type* returnType);
+    bool lower(ForStatement* forStmt, llvm::Type* returnType);
+    bool lower(FunctionDefinition*, llvm::Type*) { return false; }
+    bool lower(ModuleImport*, llvm::Type*) { return false; }
+    llvm::Value* lower(NumberExpression* num);
+    llvm::Value* lower(FloatExpression* fl);
+    llvm::Value* lower(StringExpression* str);
+    llvm::Value* lower(BoolExpression* bl);
+    llvm::Value* lower(VariableExpression* var);
+    llvm::Value* lower(UnaryExpression* unary);
+    llvm::Value* lower(BinaryExpression* bin);
+    llvm::Value* lower(CallExpression* call);
+    llvm::Value* lower(AssignmentExpression* assign);
+    llvm::Value* lowerRand(llvm::Value* min, llvm::Value* max);
+};
+
+// The textual backend's name for type, which printfFormat understands.
+std::string irTypeName(llvm::Type* type) {
+    if (type->isDoubleTy()) return "double";
+    if (type->isPointerTy()) return "i8*";
+    if (type->isIntegerTy(1)) return "i1";
+    if (type->isVoidTy()) return "void";
+    return "i32";
+}
+
+llvm::Type* Lowering::typeOf(std::string_view vulpesType) {
+    std::string name = frontend.mapType(vulpesType);
+    if (name == "double") return builder.getDoubleTy();
+    if (name == "i1") return builder.getInt1Ty();
+    if (name == "i8*") return builder.getInt8PtrTy();
+    if (name == "void") return builder.getVoidTy();
+    return builder.getInt32Ty();
+}
+
+llvm::FunctionType* Lowering::signature(const FunctionInfo& info) {
+    std::vector<llvm::Type*> parameters;
+    for (const Parameter& param : info.parameters) parameters.push_back(typeOf(param.type));
+    return llvm::FunctionType::get(typeOf(info.definition->returnType), parameters, false);
+}
+
+llvm::FunctionCallee Lowering::runtime(const char* name) {
+    std::string_view which = name;
+    if (which == "printf" || which == "scanf") {
+        return module.getOrInsertFunction(name, llvm::FunctionType::get(builder.getInt32Ty(), {builder.getInt8PtrTy()}, true));
+    }
+    if (which == "sqrt") {
+        return module.getOrInsertFunction(name, llvm::FunctionType::get(builder.getDoubleTy(), {builder.getDoubleTy()}, false));
+    }
+    return module.getOrInsertFunction(name, llvm::FunctionType::get(builder.getInt64Ty(), {builder.getInt8PtrTy()}, false));
+}
+
+// rand()'s seed and whether it has been set, created on first use.
+llvm::GlobalVariable* Lowering::runtimeState(const char* name, llvm::Constant* initial) {
+    if (llvm::GlobalVariable* existing = module.getNamedGlobal(name)) return existing;
+    auto* global = new llvm::GlobalVariable(module, initial->getType(), false, llvm::GlobalValue::ExternalLinkage,
+                                            initial, name);
+    global->setAlignment(llvm::Align(initial->getType()->isIntegerTy(1) ? 1 : 4));
+    return global;
+}
+
+// Locals live in the entry block, where mem2reg looks for them.
+llvm::AllocaInst* Lowering::allocate(llvm::Type* type, Symbol name) {
+    llvm::BasicBlock& entry = function->getEntryBlock();
+    llvm::IRBuilder<> entryBuilder(&entry, entry.begin());
+    return entryBuilder.CreateAlloca(type, nullptr, std::string(symbolName(name)));
+}
+
+Variable* Lowering::resolve(Symbol name) {
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+        auto found = it->find(name);
+        if (found != it->end()) return &found->second;
+    }
+    return nullptr;
+}
+
+llvm::Value* Lowering::convert(llvm::Value* value, llvm::Type* to) {
+    llvm::Type* from = value->getType();
+    if (from == to) return value;
+    bool fromInt = from->isIntegerTy(32);
+    bool fromBool = from->isIntegerTy(1);
+    if (fromInt && to->isDoubleTy()) return builder.CreateSIToFP(value, to);
+    if (from->isDoubleTy() && to->isIntegerTy(32)) return builder.CreateFPToSI(value, to);
+    if (fromInt && to->isIntegerTy(1)) return builder.CreateICmpNE(value, builder.getInt32(0));
+    if (from->isDoubleTy() && to->isIntegerTy(1)) {
+        return builder.CreateFCmpONE(value, llvm::ConstantFP::get(from, 0.0));
+    }
+    if (fromBool && to->isIntegerTy(32)) return builder.CreateZExt(value, to);
+    if (fromBool && to->isDoubleTy()) return builder.CreateSIToFP(builder.CreateZExt(value, builder.getInt32Ty()), to);
+    // unknown conversion, as the textual backend: the verifier rejects it
+    return value;
+}
+
+void Lowering::declare(const CodeGenerator::PlannedFunction& planned) {
+    const FunctionInfo& info = *planned.info;
+    if (llvm::Function* existing = module.getFunction(info.irName)) {
+        if (!existing->empty()) throw std::runtime_error("function " + info.irName + " is defined more than once");
+        return;
+    }
+    auto* declared = llvm::Function::Create(signature(info), llvm::Function::ExternalLinkage, info.irName, module);
+    for (size_t i = 0; i < info.parameters.size(); ++i) {
+        declared->getArg(static_cast<unsigned>(i))->setName(std::string(symbolName(info.parameters[i].name)));
+    }
+}
+
+void Lowering::define(const CodeGenerator::PlannedFunction& planned) {
+    function = module.getFunction(planned.info->irName);
+    if (!function->empty()) throw std::runtime_error("function " + planned.info->irName + " is defined more than once");
+    owner = planned.owner;
+    FunctionDefinition* func = planned.definition;
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+
+    // Parameters get slots too, so assignments to them work.
+    scopes.emplace_back();
+    for (size_t i = 0; i < func->parameters.size(); ++i) {
+        llvm::Argument* argument = function->getArg(static_cast<unsigned>(i));
+        llvm::AllocaInst* slot = allocate(argument->getType(), func->parameters[i].name);
+        builder.CreateStore(argument, slot);
+        scopes.back()[func->parameters[i].name] = {slot, argument->getType()};
+    }
+
+    llvm::Type* returnType = function->getReturnType();
+    if (func->body) {
+        for (Statement* stmt : func->body->statements) {
+            if (lowerStatement(stmt, returnType)) break;
+        }
+    }
+    if (!terminated()) {
+        if (returnType->isVoidTy()) builder.CreateRetVoid();
+        else builder.CreateRet(llvm::Constant::getNullValue(returnType));
+    }
+    scopes.pop_back();
+}
+
+void Lowering::defineMainStub() {
+    auto* stub = llvm::Function::Create(llvm::FunctionType::get(builder.getInt32Ty(), false),
+                                        llvm::Function::ExternalLinkage, "main", module);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", stub));
+    builder.CreateRet(builder.getInt32(0));
+}
+
+bool Lowering::lowerStatement(Statement* stmt, llvm::Type* returnType) {
+    // Anything after a return that didn't end its block is dead, but still
+    // needs a block of its own.
+    if (terminated()) builder.SetInsertPoint(llvm::BasicBlock::Create(context, "dead", function));
+    return visit(stmt, [&](auto* node) { return lower(node, returnType); });
+}
+
+bool Lowering::lower(BlockStatement* block, llvm::Type* returnType) {
+    scopes.emplace_back();
+    bool returned = false;
+    for (Statement* stmt : block->statements) {
+        if ((returned = lowerStatement(stmt, returnType))) break;
+    }
+    scopes.pop_back();
+    return returned;
+}
+
+bool Lowering::lower(VariableDeclaration* decl, llvm::Type*) {
+    llvm::Type* type = decl->type.empty() ? nullptr : typeOf(decl->type);
+    llvm::Value* value = nullptr;
+    if (decl->initializer) {
+        value = lowerExpression(decl->initializer);
+        if (!type) type = value->getType();
+        else value = convert(value, type);
+    } else {
+        if (!type) type = builder.getInt32Ty();
+        value = llvm::Constant::getNullValue(type);
+    }
+    llvm::AllocaInst* slot = allocate(type, decl->name);
+    builder.CreateStore(value, slot);
+    scopes.back()[decl->name] = {slot, type};
+    return false;
+}
+
+bool Lowering::lower(AssignmentStatement* assign, llvm::Type*) {
+    Variable* target = resolve(assign->name);
+    if (!target) return false;
+    builder.CreateStore(convert(lowerExpression(assign->value), target->type), target->address);
+    return false;
+}
+
+bool Lowering::lower(ExpressionStatement* exprStmt, llvm::Type*) {
+    lowerExpression(exprStmt->expression);
+    return false;
+}
+
+bool Lowering::lower(ReturnStatement* ret, llvm::Type* returnType) {
+    if (!ret->expression) {
+        builder.CreateRetVoid();
+        return true;
+    }
+    llvm::Value* value = lowerExpression(ret->expression);
+    if (!returnType->isVoidTy()) value = convert(value, returnType);
+    builder.CreateRet(value);
+    return true;
+}
+
+bool Lowering::lower(PrintStatement* print, llvm::Type*) {
+    std::vector<llvm::Value*> arguments{nullptr};
+    std::vector<std::string> argumentTypes;
+    for (Expression* arg : print->arguments) {
+        llvm::Value* value = lowerExpression(arg);
+        argumentTypes.push_back(irTypeName(value->getType()));
+        // printf has no i1 conversion.
+        if (value->getType()->isIntegerTy(1)) value = convert(value, builder.getInt32Ty());
+        arguments.push_back(value);
+    }
+    arguments[0] = builder.CreateGlobalStringPtr(printfFormat(print->format, argumentTypes), ".str");
+    builder.CreateCall(runtime("printf"), arguments);
+    return false;
+}
+
+bool Lowering::lower(GatherStatement* gather, llvm::Type*) {
+    if (!inputFormat) inputFormat = builder.CreateGlobalStringPtr("%d", ".str_input_int");
+    for (Symbol name : gather->names) {
+        Variable* var = resolve(name);
+        if (!var) {
+            llvm::AllocaInst* slot = allocate(builder.getInt32Ty(), name);
+            builder.CreateStore(builder.getInt32(0), slot);
+            var = &(scopes.back()[name] = {slot, builder.getInt32Ty()});
+        }
+        builder.CreateCall(runtime("scanf"), {inputFormat, var->address});
+    }
+    return false;
+}
+
+bool Lowering::lower(IfStatement* ifStmt, llvm::Type* returnType) {
+    llvm::Value* condition = convert(lowerExpression(ifStmt->condition), builder.getInt1Ty());
+    auto* thenBlock = llvm::BasicBlock::Create(context, "if_then", function);
+    auto* elseBlock = ifStmt->elseBranch ? llvm::BasicBlock::Create(context, "if_else", function) : nullptr;
+    auto* endBlock = llvm::BasicBlock::Create(context, "if_end", function);
+    builder.CreateCondBr(condition, thenBlock, elseBlock ? elseBlock : endBlock);
+    builder.SetInsertPoint(thenBlock);
+    lowerStatement(ifStmt->thenBranch, returnType);
+    if (!terminated()) builder.CreateBr(endBlock);
+    if (elseBlock) {
+        builder.SetInsertPoint(elseBlock);
+        lowerStatement(ifStmt->elseBranch, returnType);
+        if (!terminated()) builder.CreateBr(endBlock);
+    }
+    // Blocks are laid out in creation order; keep the end after the arms.
+    endBlock->moveAfter(builder.GetInsertBlock());
+    builder.SetInsertPoint(endBlock);
+    return false;
+}
+
+bool Lowering::lower(WhileStatement* whileStmt, llvm::Type* returnType) {
+    auto* condBlock = llvm::BasicBlock::Create(context, "while_cond", function);
+    auto* bodyBlock = llvm::BasicBlock::Create(context, "while_body", function);
+    auto* endBlock = llvm::BasicBlock::Create(context, "while_end", function);
+    builder.CreateBr(condBlock);
+    builder.SetInsertPoint(condBlock);
+    llvm::Value* condition = convert(lowerExpression(whileStmt->condition), builder.getInt1Ty());
+    builder.CreateCondBr(condition, bodyBlock, endBlock);
+    builder.SetInsertPoint(bodyBlock);
+    lowerStatement(whileStmt->body, returnType);
+    if (!terminated()) builder.CreateBr(condBlock);
+    endBlock->moveAfter(builder.GetInsertBlock());
+    builder.SetInsertPoint(endBlock);
+    return false;
+}
+
+bool Lowering::lower(ForStatement* forStmt, llvm::Type* returnType) {
+    llvm::Type* i32 = builder.getInt32Ty();
+    llvm::Value* start = convert(lowerExpression(forStmt->start), i32);
+    llvm::Value* end = convert(lowerExpression(forStmt->end), i32);
+    llvm::AllocaInst* slot = allocate(i32, forStmt->iterator);
+    builder.CreateStore(start, slot);
+    scopes.back()[forStmt->iterator] = {slot, i32};
+
+    auto* condBlock = llvm::BasicBlock::Create(context, "for_cond", function);
+    auto* bodyBlock = llvm::BasicBlock::Create(context, "for_body", function);
+    auto* endBlock = llvm::BasicBlock::Create(context, "for_end", function);
+    builder.CreateBr(condBlock);
+    builder.SetInsertPoint(condBlock);
+    llvm::Value* current = builder.CreateLoad(i32, slot);
+    builder.CreateCondBr(builder.CreateICmpSLT(current, end), bodyBlock, endBlock);
+    builder.SetInsertPoint(bodyBlock);
+    lowerStatement(forStmt->body, returnType);
+    // The next value comes from the one tested, not from the slot, so the
+    // body can't move the iterator.
+    if (!terminated()) {
+        builder.CreateStore(builder.CreateAdd(current, builder.getInt32(1)), slot);
+        builder.CreateBr(condBlock);
+    }
+    endBlock->moveAfter(builder.GetInsertBlock());
+    builder.SetInsertPoint(endBlock);
+    return false;
+}
+
+llvm::Value* Lowering::lowerExpression(Expression* expr) {
+    return visit(expr, [&](auto* node) { return lower(node); });
+}
+
+llvm::Value* Lowering::lower(NumberExpression* num) {
+    return builder.getInt32(static_cast<std::uint32_t>(num->value));
+}
+
+llvm::Value* Lowering::lower(FloatExpression* fl) {
+    return llvm::ConstantFP::get(builder.getDoubleTy(), fl->value);
+}
+
+llvm::Value* Lowering::lower(StringExpression* str) {
+    return builder.CreateGlobalStringPtr(llvm::StringRef(str->value.data(), str->value.size()), ".str");
+}
+
+llvm::Value* Lowering::lower(BoolExpression* bl) {
+    return builder.getInt1(bl->value);
+}
+
+llvm::Value* Lowering::lower(VariableExpression* var) {
+    Variable* info = resolve(var->name);
+    if (!info) return builder.getInt32(0);
+    return builder.CreateLoad(info->type, info->address);
+}
+
+llvm::Value* Lowering::lower(UnaryExpression* unary) {
+    llvm::Value* value = lowerExpression(unary->operand);
+    switch (unary->op) {
+        case UnaryOp::Negate:
+            if (value->getType()->isDoubleTy()) return builder.CreateFSub(llvm::ConstantFP::get(value->getType(), 0.0), value);
+            return builder.CreateSub(builder.getInt32(0), convert(value, builder.getInt32Ty()));
+    }
+    return value;
+}
+
+llvm::Value* Lowering::lower(BinaryExpression* bin) {
+    llvm::Value* left = lowerExpression(bin->left);
+    llvm::Value* right = lowerExpression(bin->right);
+    bool isDouble = left->getType()->isDoubleTy() || right->getType()->isDoubleTy();
+    llvm::Type* opType = isDouble ? builder.getDoubleTy() : builder.getInt32Ty();
+    left = convert(left, opType);
+    right = convert(right, opType);
+    switch (bin->op) {
+        case BinaryOp::Equal:
+            return isDouble ? builder.CreateFCmpOEQ(left, right) : builder.CreateICmpEQ(left, right);
+        case BinaryOp::NotEqual:
+            return isDouble ? builder.CreateFCmpONE(left, right) : builder.CreateICmpNE(left, right);
+        case BinaryOp::Less:
+            return isDouble ? builder.CreateFCmpOLT(left, right) : builder.CreateICmpSLT(left, right);
+        case BinaryOp::LessEqual:
+            return isDouble ? builder.CreateFCmpOLE(left, right) : builder.CreateICmpSLE(left, right);
+        case BinaryOp::Greater:
+            return isDouble ? builder.CreateFCmpOGT(left, right) : builder.CreateICmpSGT(left, right);
+        case BinaryOp::GreaterEqual:
+            return isDouble ? builder.CreateFCmpOGE(left, right) : builder.CreateICmpSGE(left, right);
+        case BinaryOp::Add:
+            return isDouble ? builder.CreateFAdd(left, right) : builder.CreateAdd(left, right);
+        case BinaryOp::Subtract:
+            return isDouble ? builder.CreateFSub(left, right) : builder.CreateSub(left, right);
+        case BinaryOp::Multiply:
+            return isDouble ? builder.CreateFMul(left, right) : builder.CreateMul(left, right);
+        case BinaryOp::Divide:
+            return isDouble ? builder.CreateFDiv(left, right) : builder.CreateSDiv(left, right);
+    }
+    return left;
+}
+
+llvm::Value* Lowering::lower(CallExpression* call) {
+    // builtins
+    static const Symbol sqrtSymbol = intern("sqrt");
+    static const Symbol randSymbol = intern("rand");
+    if (call->name == sqrtSymbol && call->arguments.size() == 1) {
+        llvm::Value* value = convert(lowerExpression(call->arguments[0]), builder.getDoubleTy());
+        return builder.CreateCall(runtime("sqrt"), {value});
+    }
+    if (call->name == randSymbol && call->arguments.size() == 2) {
+        llvm::Value* min = convert(lowerExpression(call->arguments[0]), builder.getInt32Ty());
+        llvm::Value* max = convert(lowerExpression(call->arguments[1]), builder.getInt32Ty());
+        return lowerRand(min, max);
+    }
+
+    const FunctionInfo* info = frontend.resolveFunction(call, owner);
+    if (!info) return builder.getInt32(0);
+    llvm::Function* callee = module.getFunction(info->irName);
+    llvm::FunctionType* type = callee ? callee->getFunctionType() : signature(*info);
+    std::vector<llvm::Value*> arguments;
+    for (size_t i = 0; i < call->arguments.size(); ++i) {
+        llvm::Value* value = lowerExpression(call->arguments[i]);
+        if (i < type->getNumParams()) value = convert(value, type->getParamType(static_cast<unsigned>(i)));
+        arguments.push_back(value);
+    }
+    return builder.CreateCall(module.getOrInsertFunction(info->irName, type), arguments);
+}
+
+// The textual backend's generator: a time-seeded LCG, reduced to [min, max].
+llvm::Value* Lowering::lowerRand(llvm::Value* min, llvm::Value* max) {
+    llvm::Type* i32 = builder.getInt32Ty();
+    llvm::GlobalVariable* seedSlot = runtimeState("rand_seed", builder.getInt32(1));
+    llvm::GlobalVariable* seededSlot = runtimeState("rand_seeded", builder.getFalse());
+    auto* seedBlock = llvm::BasicBlock::Create(context, "seed", function);
+    auto* contBlock = llvm::BasicBlock::Create(context, "cont", function);
+    builder.CreateCondBr(builder.CreateLoad(builder.getInt1Ty(), seededSlot), contBlock, seedBlock);
+    builder.SetInsertPoint(seedBlock);
+    llvm::Value* now = builder.CreateCall(runtime("time"), {llvm::ConstantPointerNull::get(builder.getInt8PtrTy())});
+    builder.CreateStore(builder.CreateTrunc(now, i32), seedSlot);
+    builder.CreateStore(builder.getTrue(), seededSlot);
+    builder.CreateBr(contBlock);
+    builder.SetInsertPoint(contBlock);
+    llvm::Value* seed = builder.CreateLoad(i32, seedSlot);
+    seed = builder.CreateMul(seed, builder.getInt32(1103515245));
+    seed = builder.CreateAdd(seed, builder.getInt32(12345));
+    seed = builder.CreateAnd(seed, builder.getInt32(2147483647));
+    builder.CreateStore(seed, seedSlot);
+    llvm::Value* size = builder.CreateAdd(builder.CreateSub(max, min), builder.getInt32(1));
+    return builder.CreateAdd(min, builder.CreateURem(seed, size));
+}
+
+llvm::Value* Lowering::lower(AssignmentExpression* assign) {
+    Variable* target = resolve(assign->name);
+    if (!target) return builder.getInt32(0);
+    llvm::Value* value = convert(lowerExpression(assign->value), target->type);
+    builder.CreateStore(value, target->address);
+    return value;
+}
+
+// The host, configured as the textual backend's llc run is: PIC, generic
+// CPU, default optimization.
+void initializeHostTarget() {
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+    });
+}
+
+std::unique_ptr<llvm::TargetMachine> hostTargetMachine() {
+    initializeHostTarget();
+    std::string triple = llvm::sys::getProcessTriple();
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) throw std::runtime_error("no code generator for " + triple + ": " + error);
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None, llvm::CodeGenOpt::Default));
+}
+
+template <typename T>
+T orThrow(llvm::Expected<T> value) {
+    if (!value) throw std::runtime_error("JIT: " + llvm::toString(value.takeError()));
+    return std::move(*value);
+}
+
+void orThrow(llvm::Error error) {
+    if (error) throw std::runtime_error("JIT: " + llvm::toString(std::move(error)));
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+LLVMBackend::LLVMBackend() : state(std::make_unique<State>()) {}
+
+LLVMBackend::~LLVMBackend() = default;
+
+void LLVMBackend::lower(CodeGenerator& frontend, const std::vector<Statement*>& program, bool keepNames) {
+    state->module.reset();
+    if (!state->context) state->context = std::make_unique<llvm::LLVMContext>();
+    state->module = std::make_unique<llvm::Module>("vulpes_module", *state->context);
+    llvm::Module& module = *state->module;
+    // Names only matter to a reader of the IR; naming every value costs
+    // time here and in the bitcode.
+    state->context->setDiscardValueNames(!keepNames);
+    if (!state->target) state->target = hostTargetMachine();
+    module.setDataLayout(state->target->createDataLayout());
+    module.setTargetTriple(state->target->getTargetTriple().str());
+
+    std::vector<CodeGenerator::PlannedFunction> planned = frontend.plan(program);
+    Lowering lowering(frontend, module);
+    // Everything is declared first so calls see their callees' real types.
+    for (const auto& function : planned) lowering.declare(function);
+    for (const auto& function : planned) lowering.define(function);
+    if (!module.getFunction("main")) lowering.defineMainStub();
+
+    std::string problems;
+    llvm::raw_string_ostream report(problems);
+    if (llvm::verifyModule(module, &report)) {
+        throw std::runtime_error("generated IR is invalid: " + report.str());
+    }
+}
+
+std::string LLVMBackend::text() const {
+    std::string text;
+    llvm::raw_string_ostream out(text);
+    if (state->module) state->module->print(out, nullptr);
+    return out.str();
+}
+
+std::string LLVMBackend::emitObject() {
+    llvm::SmallVector<char, 0> object;
+    llvm::raw_svector_ostream out(object);
+    llvm::legacy::PassManager passes;
+    if (state->target->addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile)) {
+        throw std::runtime_error("the host code generator can't emit object files");
+    }
+    passes.run(*state->module);
+    return std::string(object.begin(), object.end());
+}
+
+LLVMBackend::JitRun LLVMBackend::runJit() {
+    initializeHostTarget();
+    JitRun result;
+    auto start = std::chrono::steady_clock::now();
+    // Unoptimized code generation: a script's time to first output is
+    // mostly this.
+    llvm::orc::JITTargetMachineBuilder host = orThrow(llvm::orc::JITTargetMachineBuilder::detectHost());
+    host.setCodeGenOptLevel(llvm::CodeGenOpt::None);
+    std::unique_ptr<llvm::orc::LLJIT> jit =
+        orThrow(llvm::orc::LLJITBuilder().setJITTargetMachineBuilder(std::move(host)).create());
+    // printf, scanf, sqrt and time are whatever this process links to.
+    const llvm::DataLayout& layout = jit->getDataLayout();
+    jit->getMainJITDylib().addGenerator(
+        orThrow(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(layout.getGlobalPrefix())));
+    state->module->setDataLayout(layout);
+    orThrow(jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(state->module), std::move(state->context))));
+    // Compiling happens here, on the first lookup.
+    auto* entry = reinterpret_cast<int (*)()>(orThrow(jit->lookup("main")).getAddress());
+    result.compileMilliseconds = millisecondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    result.status = entry();
+    std::fflush(nullptr);
+    result.runMilliseconds = millisecondsSince(start);
+    return result;
+}
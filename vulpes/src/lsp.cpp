@@ -0,0 +1,704 @@
+#include "lsp.hpp"
+#include "error_handler.hpp"
+#include "lexer.hpp"
+#include "module_cache.hpp"
+#include "parser.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Just enough JSON for the protocol's messages.
+struct Json {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> members;
+
+    // A null value if the member or item is missing.
+    const Json& operator[](std::string_view key) const {
+        for (const auto& member : members) {
+            if (member.first == key) return member.second;
+        }
+        return null();
+    }
+    const Json& operator[](size_t index) const { return index < items.size() ? items[index] : null(); }
+
+    bool has(std::string_view key) const { return (*this)[key].type != Type::Null; }
+    long integer() const { return static_cast<long>(number); }
+
+    static const Json& null() {
+        static const Json value;
+        return value;
+    }
+};
+
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text) : text(text) {}
+
+    bool parse(Json& out) {
+        out = value(0);
+        skipSpace();
+        return ok && pos == text.size();
+    }
+
+private:
+    static constexpr int MaxDepth = 64;
+
+    std::string_view text;
+    size_t pos = 0;
+    bool ok = true;
+
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            ++pos;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos < text.size() && text[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(std::string_view word) {
+        if (text.substr(pos, word.size()) != word) return false;
+        pos += word.size();
+        return true;
+    }
+
+    Json value(int depth) {
+        Json result;
+        skipSpace();
+        if (pos >= text.size() || depth > MaxDepth) {
+            ok = false;
+            return result;
+        }
+        char c = text[pos];
+        if (c == '{') {
+            ++pos;
+            result.type = Json::Type::Object;
+            if (consume('}')) return result;
+            do {
+                skipSpace();
+                if (pos >= text.size() || text[pos] != '"') {
+                    ok = false;
+                    return result;
+                }
+                std::string key = string();
+                if (!consume(':')) {
+                    ok = false;
+                    return result;
+                }
+                result.members.emplace_back(std::move(key), value(depth + 1));
+            } while (ok && consume(','));
+            if (!consume('}')) ok = false;
+        } else if (c == '[') {
+            ++pos;
+            result.type = Json::Type::Array;
+            if (consume(']')) return result;
+            do {
+                result.items.push_back(value(depth + 1));
+            } while (ok && consume(','));
+            if (!consume(']')) ok = false;
+        } else if (c == '"') {
+            result.type = Json::Type::String;
+            result.string = string();
+        } else if (literal("true") || literal("false")) {
+            result.type = Json::Type::Bool;
+            result.boolean = c == 't';
+        } else if (literal("null")) {
+        } else {
+            size_t start = pos;
+            while (pos < text.size() && std::string_view("+-.eE0123456789").find(text[pos]) != std::string_view::npos) {
+                ++pos;
+            }
+            std::string number(text.substr(start, pos - start));
+            char* end = nullptr;
+            result.type = Json::Type::Number;
+            result.number = std::strtod(number.c_str(), &end);
+            if (number.empty() || *end != '\0') ok = false;
+        }
+        return result;
+    }
+
+    unsigned hex4() {
+        if (pos + 4 > text.size()) {
+            ok = false;
+            return 0;
+        }
+        unsigned value = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text[pos++];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= static_cast<unsigned>(c - '0');
+            else if (c >= 'a' && c <= 'f') value |= static_cast<unsigned>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') value |= static_cast<unsigned>(c - 'A' + 10);
+            else ok = false;
+        }
+        return value;
+    }
+
+    static void appendUtf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    // At the opening quote.
+    std::string string() {
+        std::string out;
+        ++pos;
+        while (pos < text.size() && text[pos] != '"') {
+            char c = text[pos++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size()) break;
+            char escape = text[pos++];
+            switch (escape) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    unsigned code = hex4();
+                    if (code >= 0xd800 && code < 0xdc00 && text.substr(pos, 2) == "\\u") {
+                        pos += 2;
+                        unsigned low = hex4();
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default: out += escape; break;
+            }
+        }
+        if (pos >= text.size()) ok = false;
+        ++pos;
+        return out;
+    }
+};
+
+std::string quote(std::string_view text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            case '\r': out += "\\r"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof escaped, "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+// Request ids are numbers or strings.
+std::string idText(const Json& id) {
+    if (id.type == Json::Type::String) return quote(id.string);
+    if (id.type == Json::Type::Number) return std::to_string(id.integer());
+    return "null";
+}
+
+// Positions in the protocol count UTF-16 code units; the compiler counts
+// bytes.
+size_t utf8Length(unsigned char lead) {
+    return lead < 0x80 ? 1 : lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+}
+
+size_t bytesForUnits(std::string_view line, long units) {
+    size_t i = 0;
+    while (i < line.size() && line[i] != '\n' && units > 0) {
+        size_t length = utf8Length(static_cast<unsigned char>(line[i]));
+        units -= length == 4 ? 2 : 1;
+        i += length;
+    }
+    return std::min(i, line.size());
+}
+
+long unitsForBytes(std::string_view line, size_t bytes) {
+    long units = 0;
+    for (size_t i = 0; i < bytes && i < line.size() && line[i] != '\n';) {
+        size_t length = utf8Length(static_cast<unsigned char>(line[i]));
+        units += length == 4 ? 2 : 1;
+        i += length;
+    }
+    return units;
+}
+
+std::string position(long line, long character) {
+    return "{\"line\":" + std::to_string(line) + ",\"character\":" + std::to_string(character) + "}";
+}
+
+std::string location(const std::string& uri, long line, long character) {
+    return "{\"uri\":" + quote(uri) + ",\"range\":{\"start\":" + position(line, character) +
+           ",\"end\":" + position(line, character) + "}}";
+}
+
+std::string pathFromUri(const std::string& uri) {
+    std::string_view rest = uri;
+    if (rest.substr(0, 7) == "file://") rest.remove_prefix(7);
+    std::string path;
+    for (size_t i = 0; i < rest.size(); ++i) {
+        if (rest[i] == '%' && i + 2 < rest.size()) {
+            path += static_cast<char>(std::strtol(std::string(rest.substr(i + 1, 2)).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            path += rest[i];
+        }
+    }
+    return path;
+}
+
+std::string uriFromPath(const std::string& path) {
+    std::string uri = "file://";
+    for (unsigned char c : path) {
+        if (std::isalnum(c) || std::string_view("/-._~").find(static_cast<char>(c)) != std::string_view::npos) {
+            uri += static_cast<char>(c);
+        } else {
+            char escaped[4];
+            std::snprintf(escaped, sizeof escaped, "%%%02X", c);
+            uri += escaped;
+        }
+    }
+    return uri;
+}
+
+bool isIdentifierChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// A run of top-level declarations starting at a top-level fx, or at the
+// start of the file for the first, and ending where the next one starts.
+// Error positions are kept relative to the chunk's start (lines, and
+// columns on its first line), so an edit above it only has to move begin
+// and line.
+struct Chunk {
+    size_t begin = 0;
+    int line = 1;
+    std::unique_ptr<ASTContext> context;
+    std::vector<Statement*> statements;
+    std::vector<CompilerError> errors;
+};
+
+struct Document {
+    std::string path;
+    std::string text;
+    std::vector<Chunk> chunks; // never empty; the first begins at 0
+
+    size_t chunkEnd(size_t index) const {
+        return index + 1 < chunks.size() ? chunks[index + 1].begin : text.size();
+    }
+
+    // Index of the chunk holding offset.
+    size_t chunkAt(size_t offset) const {
+        auto after = std::upper_bound(chunks.begin(), chunks.end(), offset,
+                                      [](size_t value, const Chunk& chunk) { return value < chunk.begin; });
+        return after == chunks.begin() ? 0 : static_cast<size_t>(after - chunks.begin()) - 1;
+    }
+
+    // Offset of the start of 1-based line, found from the nearest chunk
+    // above it; text.size() past the end.
+    size_t lineStart(int line) const {
+        auto after = std::upper_bound(chunks.begin(), chunks.end(), line,
+                                      [](int value, const Chunk& chunk) { return value < chunk.line; });
+        const Chunk& chunk = after == chunks.begin() ? chunks.front() : *(after - 1);
+        size_t offset = chunk.begin;
+        while (offset > 0 && text[offset - 1] != '\n') --offset; // chunks may start mid-line
+        for (int current = std::min(chunk.line, line); current < line; ++current) {
+            size_t newline = text.find('\n', offset);
+            if (newline == std::string::npos) return text.size();
+            offset = newline + 1;
+        }
+        return offset;
+    }
+
+    size_t offsetOf(const Json& pos) const {
+        size_t start = lineStart(static_cast<int>(pos["line"].integer()) + 1);
+        return start + bytesForUnits(std::string_view(text).substr(start), pos["character"].integer());
+    }
+
+    // 1-based byte column of offset.
+    int columnOf(size_t offset) const {
+        size_t newline = offset == 0 ? std::string::npos : text.rfind('\n', offset - 1);
+        return static_cast<int>(offset - (newline == std::string::npos ? 0 : newline + 1)) + 1;
+    }
+
+    long characterOf(int line, int column) const {
+        size_t start = lineStart(line);
+        return unitsForBytes(std::string_view(text).substr(start), column > 0 ? static_cast<size_t>(column - 1) : 0);
+    }
+};
+
+void parseChunk(Document& doc, size_t index, const SourceManager& sources) {
+    Chunk& chunk = doc.chunks[index];
+    chunk.context = std::make_unique<ASTContext>();
+    ErrorHandler handler(sources, InvalidFileID);
+    Lexer lexer(doc.text, {chunk.begin, chunk.line}, doc.chunkEnd(index));
+    Parser parser(lexer, handler, *chunk.context);
+    chunk.statements = parser.parseProgram();
+    chunk.errors = handler.getErrors();
+    int column = doc.columnOf(chunk.begin);
+    for (CompilerError& error : chunk.errors) {
+        error.location.line -= chunk.line;
+        if (error.location.line == 0) error.location.column -= column - 1;
+    }
+}
+
+// Chunks [first, stop) no longer match the text. Re-lexes from the start of
+// first, cutting at each top-level fx as Lexer::topLevelFunctions would,
+// until a cut falls exactly where a later chunk already begins: the lexer
+// is between tokens and outside braces there, just as before the edit, so
+// everything after it is unchanged. Only the chunks in between are parsed.
+void relex(Document& doc, size_t first, size_t stop, const SourceManager& sources) {
+    std::string_view source = doc.text;
+    std::vector<SourceOffset> starts{{doc.chunks[first].begin, doc.chunks[first].line}};
+    size_t resume = doc.chunks.size();
+    size_t next = stop;
+    Lexer lexer(source, starts.front(), source.size());
+    int depth = 0;
+    for (Token token = lexer.next(); token.type != TokenType::EndOfFile; token = lexer.next()) {
+        if (token.type == TokenType::LeftBrace) {
+            ++depth;
+        } else if (token.type == TokenType::RightBrace) {
+            if (depth > 0) --depth;
+        } else if (token.type == TokenType::Fx && depth == 0) {
+            size_t offset = static_cast<size_t>(token.lexeme.data() - source.data());
+            if (offset == starts.front().offset) continue;
+            while (next < doc.chunks.size() && doc.chunks[next].begin < offset) ++next;
+            if (next < doc.chunks.size() && doc.chunks[next].begin == offset) {
+                resume = next;
+                break;
+            }
+            starts.push_back({offset, token.line});
+        }
+    }
+
+    std::vector<Chunk> fresh(starts.size());
+    for (size_t i = 0; i < starts.size(); ++i) {
+        fresh[i].begin = starts[i].offset;
+        fresh[i].line = starts[i].line;
+    }
+    doc.chunks.erase(doc.chunks.begin() + static_cast<long>(first), doc.chunks.begin() + static_cast<long>(resume));
+    doc.chunks.insert(doc.chunks.begin() + static_cast<long>(first), std::make_move_iterator(fresh.begin()),
+                      std::make_move_iterator(fresh.end()));
+    for (size_t i = first; i < first + starts.size(); ++i) parseChunk(doc, i, sources);
+}
+
+void replaceText(Document& doc, size_t start, size_t end, const std::string& replacement,
+                 const SourceManager& sources) {
+    start = std::min(start, doc.text.size());
+    end = std::min(std::max(end, start), doc.text.size());
+    // The chunk above is relexed too: the edit may have broken the fx that
+    // starts this one, or be text that belongs at the end of the one above.
+    size_t first = doc.chunkAt(start);
+    if (first > 0) --first;
+    size_t last = doc.chunkAt(end);
+
+    long lineDelta = std::count(replacement.begin(), replacement.end(), '\n') -
+                     std::count(doc.text.begin() + static_cast<long>(start), doc.text.begin() + static_cast<long>(end), '\n');
+    long delta = static_cast<long>(replacement.size()) - static_cast<long>(end - start);
+    doc.text.replace(start, end - start, replacement);
+    for (size_t i = last + 1; i < doc.chunks.size(); ++i) {
+        doc.chunks[i].begin = static_cast<size_t>(static_cast<long>(doc.chunks[i].begin) + delta);
+        doc.chunks[i].line += static_cast<int>(lineDelta);
+    }
+    relex(doc, first, last + 1, sources);
+}
+
+void setText(Document& doc, std::string text, const SourceManager& sources) {
+    doc.text = std::move(text);
+    doc.chunks.clear();
+    doc.chunks.emplace_back();
+    relex(doc, 0, 1, sources);
+}
+
+class Server {
+public:
+    explicit Server(std::ostream& out) : out(out), sources(true), modules(sources) {}
+
+    // False once the client sends exit.
+    bool handle(const std::string& body);
+    int exitStatus() const { return shutdownRequested ? 0 : 1; }
+
+private:
+    struct Place {
+        int line;   // 1-based
+        int column; // 1-based, in bytes
+    };
+
+    std::ostream& out;
+    SourceManager sources;
+    ModuleCache modules;
+    std::map<std::string, Document> documents; // by URI
+    struct ModuleFunctions {
+        FileID file = InvalidFileID; // the version they were found in
+        std::unordered_map<Symbol, Place> places;
+    };
+    std::unordered_map<std::string, ModuleFunctions> moduleFunctions; // by canonical path
+    bool shutdownRequested = false;
+
+    void send(const std::string& body) {
+        out << "Content-Length: " << body.size() << "\r\n\r\n" << body << std::flush;
+    }
+    void respond(const Json& id, const std::string& result) {
+        send("{\"jsonrpc\":\"2.0\",\"id\":" + idText(id) + ",\"result\":" + result + "}");
+    }
+    void fail(const Json& id, int code, const std::string& message) {
+        send("{\"jsonrpc\":\"2.0\",\"id\":" + idText(id) + ",\"error\":{\"code\":" + std::to_string(code) +
+             ",\"message\":" + quote(message) + "}}");
+    }
+
+    bool dispatch(const Json& message);
+    void publish(const std::string& uri, const Document* doc);
+    std::string definition(const Document& doc, size_t offset);
+    std::string findInDocument(const std::string& uri, const Document& doc, Symbol name);
+    const std::unordered_map<Symbol, Place>& functionsIn(const Module& module);
+    std::shared_ptr<Module> importedModule(const Document& doc, Symbol alias);
+};
+
+bool Server::handle(const std::string& body) {
+    Json message;
+    if (!JsonReader(body).parse(message)) {
+        fail(Json::null(), -32700, "malformed message");
+        return true;
+    }
+    return dispatch(message);
+}
+
+bool Server::dispatch(const Json& message) {
+    const std::string& method = message["method"].string;
+    const Json& id = message["id"];
+    const Json& params = message["params"];
+    bool request = message.has("id");
+
+    if (method == "initialize") {
+        respond(id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+                    "\"definitionProvider\":true},\"serverInfo\":{\"name\":\"vulpes\"}}");
+    } else if (method == "shutdown") {
+        shutdownRequested = true;
+        respond(id, "null");
+    } else if (method == "exit") {
+        return false;
+    } else if (method == "textDocument/didOpen") {
+        const Json& item = params["textDocument"];
+        Document& doc = documents[item["uri"].string];
+        doc.path = pathFromUri(item["uri"].string);
+        setText(doc, item["text"].string, sources);
+        publish(item["uri"].string, &doc);
+    } else if (method == "textDocument/didChange") {
+        const std::string& uri = params["textDocument"]["uri"].string;
+        auto found = documents.find(uri);
+        if (found == documents.end()) return true;
+        Document& doc = found->second;
+        for (const Json& change : params["contentChanges"].items) {
+            if (!change.has("range")) {
+                setText(doc, change["text"].string, sources);
+                continue;
+            }
+            const Json& range = change["range"];
+            replaceText(doc, doc.offsetOf(range["start"]), doc.offsetOf(range["end"]), change["text"].string,
+                        sources);
+        }
+        publish(uri, &doc);
+    } else if (method == "textDocument/didClose") {
+        const std::string& uri = params["textDocument"]["uri"].string;
+        documents.erase(uri);
+        publish(uri, nullptr);
+    } else if (method == "textDocument/definition") {
+        auto found = documents.find(params["textDocument"]["uri"].string);
+        if (found == documents.end()) {
+            respond(id, "null");
+        } else {
+            respond(id, definition(found->second, found->second.offsetOf(params["position"])));
+        }
+    } else if (request) {
+        fail(id, -32601, "unsupported method " + method);
+    }
+    return true;
+}
+
+// Diagnostics for the whole document, from every chunk; none for a closed
+// one.
+void Server::publish(const std::string& uri, const Document* doc) {
+    std::string list;
+    if (doc) {
+        for (const Chunk& chunk : doc->chunks) {
+            for (const CompilerError& error : chunk.errors) {
+                int line = chunk.line + error.location.line;
+                int column = error.location.column;
+                if (error.location.line == 0) column += doc->columnOf(chunk.begin) - 1;
+                long character = doc->characterOf(line, column);
+                int severity = error.severity == ErrorSeverity::WARNING ? 2 : 1;
+                if (!list.empty()) list += ",";
+                list += "{\"range\":{\"start\":" + position(line - 1, character) +
+                        ",\"end\":" + position(line - 1, character + 1) + "},\"severity\":" +
+                        std::to_string(severity) + ",\"source\":\"vulpes\",\"message\":" + quote(error.message) + "}";
+            }
+        }
+    }
+    send("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":" + quote(uri) +
+         ",\"diagnostics\":[" + list + "]}}");
+}
+
+// The word under the cursor: a function of this file, or alias.name for a
+// function of an imported module, or an alias, which leads to the module.
+std::string Server::definition(const Document& doc, size_t offset) {
+    std::string_view text = doc.text;
+    size_t begin = offset;
+    size_t end = offset;
+    while (begin > 0 && isIdentifierChar(text[begin - 1])) --begin;
+    while (end < text.size() && isIdentifierChar(text[end])) ++end;
+    if (begin == end) return "null";
+    Symbol word = intern(text.substr(begin, end - begin));
+
+    std::string uri = uriFromPath(doc.path);
+    if (begin > 0 && text[begin - 1] == '.') {
+        size_t aliasEnd = begin - 1;
+        size_t aliasBegin = aliasEnd;
+        while (aliasBegin > 0 && isIdentifierChar(text[aliasBegin - 1])) --aliasBegin;
+        std::shared_ptr<Module> module = importedModule(doc, intern(text.substr(aliasBegin, aliasEnd - aliasBegin)));
+        if (!module) return "null";
+        bool declared = false;
+        for (Statement* stmt : module->statements) {
+            auto* func = dyn_cast<FunctionDefinition>(stmt);
+            if (func && func->name == word) declared = true;
+        }
+        const auto& places = functionsIn(*module);
+        auto place = places.find(word);
+        if (!declared || place == places.end()) return "null";
+        long character = unitsForBytes(sources.line(module->file, place->second.line),
+                                       static_cast<size_t>(place->second.column - 1));
+        return location(uriFromPath(module->canonicalPath), place->second.line - 1, character);
+    }
+    if (end < text.size() && text[end] == '.') {
+        if (auto module = importedModule(doc, word)) return location(uriFromPath(module->canonicalPath), 0, 0);
+    }
+    return findInDocument(uri, doc, word);
+}
+
+std::string Server::findInDocument(const std::string& uri, const Document& doc, Symbol name) {
+    for (size_t i = 0; i < doc.chunks.size(); ++i) {
+        const Chunk& chunk = doc.chunks[i];
+        bool declared = false;
+        for (Statement* stmt : chunk.statements) {
+            auto* func = dyn_cast<FunctionDefinition>(stmt);
+            if (func && func->name == name) declared = true;
+        }
+        if (!declared) continue;
+        Lexer lexer(doc.text, {chunk.begin, chunk.line}, doc.chunkEnd(i));
+        for (Token token = lexer.next(); token.type != TokenType::EndOfFile; token = lexer.next()) {
+            if (token.type != TokenType::Fx) continue;
+            Token ident = lexer.next();
+            if (ident.type == TokenType::Identifier && ident.symbol == name) {
+                return location(uri, ident.line - 1, doc.characterOf(ident.line, ident.column));
+            }
+        }
+    }
+    return "null";
+}
+
+// The module a mod(...) statement of doc imports as alias, resolved like the
+// compiler does: next to the document first, then as given.
+std::shared_ptr<Module> Server::importedModule(const Document& doc, Symbol alias) {
+    for (const Chunk& chunk : doc.chunks) {
+        for (Statement* stmt : chunk.statements) {
+            auto* mod = dyn_cast<ModuleImport>(stmt);
+            if (!mod || mod->alias != alias) continue;
+            std::string path(mod->path);
+            if (!path.empty() && path[0] != '/') {
+                std::string directory = doc.path.substr(0, doc.path.find_last_of('/') + 1);
+                if (auto module = modules.load(directory + path)) return module;
+            }
+            return modules.load(path);
+        }
+    }
+    return nullptr;
+}
+
+// Where each top-level function of module is named, found by lexing each
+// version of the module once.
+const std::unordered_map<Symbol, Server::Place>& Server::functionsIn(const Module& module) {
+    ModuleFunctions& entry = moduleFunctions[module.canonicalPath];
+    if (entry.file != module.file) {
+        entry.file = module.file;
+        entry.places.clear();
+        std::string_view buffer = sources.buffer(module.file);
+        for (const SourceOffset& start : Lexer::topLevelFunctions(buffer)) {
+            Lexer lexer(buffer, start, buffer.size());
+            lexer.next();
+            Token name = lexer.next();
+            if (name.type == TokenType::Identifier) entry.places.emplace(name.symbol, Place{name.line, name.column});
+        }
+    }
+    return entry.places;
+}
+
+// One message framed by a Content-Length header; false at end of input.
+bool readMessage(std::istream& in, std::string& body) {
+    std::string line;
+    long length = -1;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) {
+            if (length >= 0) break;
+            continue;
+        }
+        if (line.compare(0, 15, "Content-Length:") == 0) length = std::strtol(line.c_str() + 15, nullptr, 10);
+    }
+    if (length < 0 || !in) return false;
+    body.resize(static_cast<size_t>(length));
+    return static_cast<bool>(in.read(&body[0], length));
+}
+
+} // namespace
+
+int runLanguageServer(std::istream& in, std::ostream& out) {
+    Server server(out);
+    std::string body;
+    while (readMessage(in, body)) {
+        if (!server.handle(body)) break;
+    }
+    return server.exitStatus();
+}
@@ -0,0 +1,221 @@
+#include "module_cache.hpp"
+#include "fingerprint.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+bool readFile(const std::string& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+// Writes beside path and renames over it, so a concurrent reader never sees
+// a half-written file.
+void writeFileAtomically(const std::string& path, const std::string& bytes) {
+    std::string temporary = path + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) std::remove(temporary.c_str());
+}
+} // namespace
+
+ModuleCache::ModuleCache(SourceManager& sources) : sources(sources) {}
+
+void ModuleCache::setInterfaceDirectory(std::string dir) {
+    if (!dir.empty() && ::mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        throw std::runtime_error("could not create module cache directory " + dir);
+    }
+    interfaceDir = std::move(dir);
+}
+
+std::string ModuleCache::interfacePath(const Module& module) const {
+    char name[17];
+    std::snprintf(name, sizeof name, "%016llx", static_cast<unsigned long long>(fnv1a(module.canonicalPath)));
+    return interfaceDir + "/" + name + ".vlpc";
+}
+
+std::shared_ptr<Module> ModuleCache::load(const std::string& path, bool* cached) {
+    FileID file = sources.load(path);
+    if (file == InvalidFileID) return nullptr;
+
+    std::shared_ptr<Module> module;
+    bool created = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const std::string& canonical = sources.canonicalPath(file);
+        auto known = byPath.find(canonical);
+        std::shared_ptr<Module>* slot = nullptr;
+        if (known == byPath.end()) {
+            byPath.emplace(canonical, modules.size());
+            slot = &modules.emplace_back();
+        } else if (modules[known->second]->file == file) {
+            module = modules[known->second];
+        } else if (modules[known->second]->file < file) {
+            slot = &modules[known->second]; // a newer version
+        }
+        // else another thread already cached a version newer than file's,
+        // and this caller gets one of its own.
+        if (!module) {
+            // The module keeps the source manager's hold on its file.
+            module.reset(new Module(), [&sources = sources](Module* old) {
+                FileID source = old->file;
+                delete old;
+                sources.release(source);
+            });
+            module->file = file;
+            module->canonicalPath = canonical;
+            module->context = std::make_unique<ASTContext>();
+            if (slot) *slot = module;
+            created = true;
+        }
+    }
+    if (!created) sources.release(file);
+
+    std::call_once(module->parsed, [this, &module] { parse(*module); });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++module->imports;
+    if (created) ++missCount;
+    else ++hitCount;
+    if (cached) *cached = !created;
+    return module;
+}
+
+void ModuleCache::parse(Module& module) {
+    module.contentHash = fnv1a(sources.buffer(module.file));
+    module.parseErrors = std::make_unique<ErrorHandler>(sources, module.file);
+    std::string path;
+    if (!interfaceDir.empty()) {
+        path = interfacePath(module);
+        std::string bytes;
+        if (readFile(path, bytes)) {
+            module.interface = ModuleInterface::decode(std::move(bytes), module.contentHash, *module.context,
+                                                       module.statements);
+            if (module.interface) return;
+        }
+    }
+
+    // With a cache to fill, bodies are parsed up front so the file has them all.
+    Lexer lexer(sources.buffer(module.file));
+    Parser parser(lexer, *module.parseErrors, *module.context);
+    parser.setLazyBodies(path.empty());
+    module.statements = parser.parseProgram();
+    module.hasErrors = module.parseErrors->hasErrors();
+    if (!path.empty() && !module.hasErrors) {
+        writeFileAtomically(path, ModuleInterface::encode(module.statements, module.contentHash));
+    }
+}
+
+// A .vlpc whose header checked out but whose body section did not is a
+// cache miss after all. The module keeps the declarations it decoded, since
+// callers already hold them, and takes each missing body from a fresh parse
+// of the same source; with every body attached the interface is never read
+// again.
+void ModuleCache::recoverFromSource(Module& module) {
+    ErrorHandler handler(sources, module.file);
+    Lexer lexer(sources.buffer(module.file));
+    Parser parser(lexer, handler, *module.context);
+    std::vector<Statement*> parsed = parser.parseProgram();
+    if (handler.hasErrors() || parsed.size() != module.statements.size()) {
+        throw std::runtime_error("damaged module cache file " + interfacePath(module));
+    }
+    for (size_t i = 0; i < parsed.size(); ++i) {
+        auto* func = dyn_cast<FunctionDefinition>(module.statements[i]);
+        if (!func || func->body) continue;
+        auto* fresh = dyn_cast<FunctionDefinition>(parsed[i]);
+        if (!fresh || fresh->name != func->name) {
+            throw std::runtime_error("damaged module cache file " + interfacePath(module));
+        }
+        func->body = fresh->body;
+    }
+    writeFileAtomically(interfacePath(module), ModuleInterface::encode(module.statements, module.contentHash));
+}
+
+void ModuleCache::reportErrors(Module& module, std::ostream& out) {
+    module.parseErrors->printErrors(out);
+}
+
+bool ModuleCache::parseBody(Module& module, FunctionDefinition* func, std::ostream& out) {
+    std::lock_guard<std::mutex> lock(module.bodyMutex);
+    if (func->body) return true;
+    if (module.interface) {
+        try {
+            return module.interface->readBody(func, *module.context);
+        } catch (const std::runtime_error&) {
+            recoverFromSource(module);
+            return func->body != nullptr;
+        }
+    }
+    if (func->deferredBody.empty()) return false;
+    ErrorHandler handler(sources, module.file);
+    bool parsed = Parser::parseDeferredBody(func, sources.buffer(module.file), handler, *module.context);
+    if (handler.hasErrors()) {
+        module.hasErrors = true;
+        handler.printErrors(out);
+    }
+    return parsed;
+}
+
+const BlockStatement* ModuleCache::transientBody(Module& module, const FunctionDefinition* func,
+                                                ASTContext& context, std::ostream& out) {
+    std::lock_guard<std::mutex> lock(module.bodyMutex);
+    if (func->body) return func->body;
+    if (module.interface) {
+        try {
+            return module.interface->decodeBody(func, context);
+        } catch (const std::runtime_error&) {
+            recoverFromSource(module);
+            return func->body;
+        }
+    }
+    if (func->deferredBody.empty()) return nullptr;
+    ErrorHandler handler(sources, module.file);
+    BlockStatement* body = Parser::parseDeferredBlock(func, sources.buffer(module.file), handler, context);
+    if (handler.hasErrors()) {
+        module.hasErrors = true;
+        handler.printErrors(out);
+    }
+    return body;
+}
+
+std::vector<std::string> ModuleCache::loadedPaths() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> paths;
+    for (const auto& module : modules) paths.push_back(module->canonicalPath);
+    return paths;
+}
+
+size_t ModuleCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+}
+
+size_t ModuleCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return missCount;
+}
+
+void ModuleCache::printStats(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& module : modules) {
+        out << "module " << module->canonicalPath << ": " << module->imports << " import"
+            << (module->imports == 1 ? "" : "s") << ", " << module->imports - 1 << " cache hit"
+            << (module->imports == 2 ? "" : "s") << (module->interface ? ", from .vlpc" : "") << "\n";
+    }
+}
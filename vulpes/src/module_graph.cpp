@@ -0,0 +1,131 @@
+#include "module_graph.hpp"
+#include "thread_pool.hpp"
+
+#include <future>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// One mod(...) statement waiting to be loaded; importer is null for the root.
+struct PendingImport {
+    const Module* importer;
+    Symbol alias;
+    std::string path;
+    std::string directory; // the importing file's, with a trailing slash
+};
+
+std::shared_ptr<Module> loadImport(ModuleCache& cache, const PendingImport& pending) {
+    if (!pending.directory.empty() && !pending.path.empty() && pending.path[0] != '/') {
+        if (auto module = cache.load(pending.directory + pending.path)) return module;
+    }
+    return cache.load(pending.path);
+}
+
+std::string directoryOf(const std::string& path) {
+    return path.substr(0, path.find_last_of('/') + 1);
+}
+
+void collectImports(const Module* importer, const std::string& directory, const std::vector<Statement*>& statements,
+                    std::vector<PendingImport>& out) {
+    for (Statement* stmt : statements) {
+        if (auto* mod = dyn_cast<ModuleImport>(stmt)) {
+            out.push_back({importer, mod->alias, std::string(mod->path), directory});
+        }
+    }
+}
+
+} // namespace
+
+ModuleGraph::ModuleGraph(const std::vector<Statement*>& root, const std::string& rootPath, ModuleCache& cache,
+                         ThreadPool* pool, std::ostream& diagnostics) {
+    std::vector<PendingImport> level;
+    collectImports(nullptr, directoryOf(rootPath), root, level);
+    std::vector<Module*> discovered; // breadth-first, for deterministic error output
+
+    while (!level.empty()) {
+        std::vector<std::shared_ptr<Module>> loaded(level.size());
+        if (pool && level.size() > 1) {
+            std::vector<std::future<std::shared_ptr<Module>>> results;
+            results.reserve(level.size());
+            for (const PendingImport& pending : level) {
+                results.push_back(pool->submit([&cache, &pending] { return loadImport(cache, pending); }));
+            }
+            for (size_t i = 0; i < results.size(); ++i) loaded[i] = results[i].get();
+        } else {
+            for (size_t i = 0; i < level.size(); ++i) loaded[i] = loadImport(cache, level[i]);
+        }
+
+        std::vector<PendingImport> next;
+        for (size_t i = 0; i < level.size(); ++i) {
+            const PendingImport& pending = level[i];
+            Module* module = loaded[i].get();
+            if (!module) {
+                std::string message = "could not open module " + pending.path;
+                if (pending.importer) message += " imported from " + pending.importer->canonicalPath;
+                throw std::runtime_error(message);
+            }
+            auto& imports = pending.importer ? edges[pending.importer] : roots;
+            imports.push_back({pending.alias, module});
+            resolved.push_back({pending.directory, pending.path, module});
+            if (edges.emplace(module, std::vector<Import>()).second) {
+                held.push_back(std::move(loaded[i]));
+                discovered.push_back(module);
+                collectImports(module, directoryOf(module->canonicalPath), module->statements, next);
+            }
+        }
+        level = std::move(next);
+    }
+
+    for (Module* module : discovered) cache.reportErrors(*module, diagnostics);
+    sort();
+}
+
+const std::vector<ModuleGraph::Import>& ModuleGraph::importsOf(const Module* module) const {
+    static const std::vector<Import> none;
+    auto found = edges.find(module);
+    return found == edges.end() ? none : found->second;
+}
+
+// Depth-first post-order from the root imports; meeting a module that is
+// still on the stack means an import cycle.
+void ModuleGraph::sort() {
+    enum class Mark { Unvisited, Active, Done };
+    std::unordered_map<const Module*, Mark> marks;
+
+    struct Frame {
+        Module* module;
+        size_t next;
+    };
+    std::vector<Frame> frames;
+    for (const Import& rootImport : roots) {
+        if (marks[rootImport.module] != Mark::Unvisited) continue;
+        frames.push_back({rootImport.module, 0});
+        marks[rootImport.module] = Mark::Active;
+        while (!frames.empty()) {
+            Frame& frame = frames.back();
+            const std::vector<Import>& imports = importsOf(frame.module);
+            if (frame.next == imports.size()) {
+                marks[frame.module] = Mark::Done;
+                order.push_back(frame.module);
+                frames.pop_back();
+                continue;
+            }
+            Module* dependency = imports[frame.next++].module;
+            Mark& mark = marks[dependency];
+            if (mark == Mark::Active) {
+                std::string cycle;
+                bool inCycle = false;
+                for (const Frame& open : frames) {
+                    inCycle = inCycle || open.module == dependency;
+                    if (inCycle) cycle += open.module->canonicalPath + " -> ";
+                }
+                throw std::runtime_error("module import cycle: " + cycle + dependency->canonicalPath);
+            }
+            if (mark == Mark::Unvisited) {
+                mark = Mark::Active;
+                frames.push_back({dependency, 0});
+            }
+        }
+    }
+}
@@ -0,0 +1,486 @@
+#include "module_interface.hpp"
+#include "fingerprint.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace {
+
+constexpr char Magic[] = {'V', 'L', 'P', 'C'};
+constexpr std::uint32_t FormatVersion = 1;
+
+// Kind byte written in place of an absent child node.
+constexpr std::uint8_t NullNode = 0xff;
+
+// How a function's body follows its signature.
+enum class BodyForm : std::uint8_t { Inline, Deferred };
+
+// Fixed-width fields in host byte order; the files are a local cache, not an
+// interchange format.
+class Writer {
+public:
+    std::string out;
+
+    void u8(std::uint8_t value) { out.push_back(static_cast<char>(value)); }
+    void u32(std::uint32_t value) { raw(&value, sizeof value); }
+    void u64(std::uint64_t value) { raw(&value, sizeof value); }
+    void f64(double value) { raw(&value, sizeof value); }
+    void text(std::string_view value) {
+        u32(static_cast<std::uint32_t>(value.size()));
+        out.append(value.data(), value.size());
+    }
+
+private:
+    void raw(const void* data, size_t size) { out.append(static_cast<const char*>(data), size); }
+};
+
+class Reader {
+public:
+    Reader(std::string_view bytes, size_t position = 0) : bytes(bytes), position(position) {}
+
+    std::uint8_t u8() { return static_cast<std::uint8_t>(take(1)[0]); }
+    std::uint32_t u32() { return fixed<std::uint32_t>(); }
+    std::uint64_t u64() { return fixed<std::uint64_t>(); }
+    double f64() { return fixed<double>(); }
+    std::string_view text() { return take(u32()); }
+    // A list length, checked against what is left at smallest bytes per
+    // element before anyone allocates for it.
+    std::uint32_t count(size_t smallest) {
+        std::uint32_t value = u32();
+        if (value > (bytes.size() - position) / smallest) throw std::runtime_error("bad count in module interface");
+        return value;
+    }
+    std::string_view take(size_t size) {
+        if (bytes.size() - position < size) throw std::runtime_error("truncated module interface");
+        std::string_view result = bytes.substr(position, size);
+        position += size;
+        return result;
+    }
+    size_t offset() const { return position; }
+
+private:
+    std::string_view bytes;
+    size_t position;
+
+    template <typename T>
+    T fixed() {
+        T value;
+        std::memcpy(&value, take(sizeof value).data(), sizeof value);
+        return value;
+    }
+};
+
+// Top-level statements go to decls, top-level function bodies to bodies, and
+// every Symbol becomes an index into the file's own name table.
+class Encoder {
+public:
+    Writer decls;
+    Writer bodies;
+    std::vector<Symbol> symbols;
+
+    void topLevel(Statement* stmt) { statement(decls, stmt, true); }
+    void nested(Statement* stmt) { statement(decls, stmt, false); }
+
+private:
+    std::unordered_map<Symbol, std::uint32_t> indices;
+
+    void symbol(Writer& out, Symbol value) {
+        auto inserted = indices.emplace(value, static_cast<std::uint32_t>(symbols.size()));
+        if (inserted.second) symbols.push_back(value);
+        out.u32(inserted.first->second);
+    }
+
+    void expressions(Writer& out, Span<Expression*> list) {
+        out.u32(static_cast<std::uint32_t>(list.size()));
+        for (Expression* expr : list) expression(out, expr);
+    }
+
+    void expression(Writer& out, Expression* expr) {
+        if (!expr) {
+            out.u8(NullNode);
+            return;
+        }
+        out.u8(static_cast<std::uint8_t>(expr->kind));
+        switch (expr->kind) {
+            case NodeKind::Number:
+                out.u32(static_cast<std::uint32_t>(cast<NumberExpression>(expr)->value));
+                break;
+            case NodeKind::Float:
+                out.f64(cast<FloatExpression>(expr)->value);
+                break;
+            case NodeKind::String:
+                out.text(cast<StringExpression>(expr)->value);
+                break;
+            case NodeKind::Bool:
+                out.u8(cast<BoolExpression>(expr)->value);
+                break;
+            case NodeKind::Variable:
+                symbol(out, cast<VariableExpression>(expr)->name);
+                break;
+            case NodeKind::Unary: {
+                auto* unary = cast<UnaryExpression>(expr);
+                out.u8(static_cast<std::uint8_t>(unary->op));
+                expression(out, unary->operand);
+                break;
+            }
+            case NodeKind::Binary: {
+                auto* binary = cast<BinaryExpression>(expr);
+                out.u8(static_cast<std::uint8_t>(binary->op));
+                expression(out, binary->left);
+                expression(out, binary->right);
+                break;
+            }
+            case NodeKind::Assignment: {
+                auto* assign = cast<AssignmentExpression>(expr);
+                symbol(out, assign->name);
+                expression(out, assign->value);
+                break;
+            }
+            default: {
+                auto* call = cast<CallExpression>(expr);
+                symbol(out, call->name);
+                symbol(out, call->ns);
+                expressions(out, call->arguments);
+                break;
+            }
+        }
+    }
+
+    void block(Writer& out, BlockStatement* blk) {
+        if (!blk) {
+            out.u8(NullNode);
+            return;
+        }
+        statement(out, blk, false);
+    }
+
+    void statement(Writer& out, Statement* stmt, bool topLevel) {
+        out.u8(static_cast<std::uint8_t>(stmt->kind));
+        switch (stmt->kind) {
+            case NodeKind::Block: {
+                auto* blk = cast<BlockStatement>(stmt);
+                out.u32(static_cast<std::uint32_t>(blk->statements.size()));
+                for (Statement* inner : blk->statements) statement(out, inner, false);
+                break;
+            }
+            case NodeKind::VariableDeclaration: {
+                auto* decl = cast<VariableDeclaration>(stmt);
+                symbol(out, decl->name);
+                out.text(decl->type);
+                out.u8(decl->isConst);
+                expression(out, decl->initializer);
+                break;
+            }
+            case NodeKind::AssignmentStatement: {
+                auto* assign = cast<AssignmentStatement>(stmt);
+                symbol(out, assign->name);
+                expression(out, assign->value);
+                break;
+            }
+            case NodeKind::ExpressionStatement:
+                expression(out, cast<ExpressionStatement>(stmt)->expression);
+                break;
+            case NodeKind::Return:
+                expression(out, cast<ReturnStatement>(stmt)->expression);
+                break;
+            case NodeKind::If: {
+                auto* ifStmt = cast<IfStatement>(stmt);
+                expression(out, ifStmt->condition);
+                block(out, ifStmt->thenBranch);
+                block(out, ifStmt->elseBranch);
+                break;
+            }
+            case NodeKind::For: {
+                auto* forStmt = cast<ForStatement>(stmt);
+                symbol(out, forStmt->iterator);
+                expression(out, forStmt->start);
+                expression(out, forStmt->end);
+                block(out, forStmt->body);
+                break;
+            }
+            case NodeKind::While: {
+                auto* whileStmt = cast<WhileStatement>(stmt);
+                expression(out, whileStmt->condition);
+                block(out, whileStmt->body);
+                break;
+            }
+            case NodeKind::Print: {
+                auto* print = cast<PrintStatement>(stmt);
+                out.text(print->format);
+                out.u8(print->formatted);
+                expressions(out, print->arguments);
+                break;
+            }
+            case NodeKind::Gather: {
+                auto* gather = cast<GatherStatement>(stmt);
+                out.u32(static_cast<std::uint32_t>(gather->names.size()));
+                for (Symbol name : gather->names) symbol(out, name);
+                break;
+            }
+            case NodeKind::FunctionDefinition: {
+                auto* func = cast<FunctionDefinition>(stmt);
+                symbol(out, func->name);
+                out.text(func->returnType);
+                out.u32(static_cast<std::uint32_t>(func->parameters.size()));
+                for (const Parameter& param : func->parameters) {
+                    out.text(param.type);
+                    symbol(out, param.name);
+                }
+                if (topLevel && func->body) {
+                    out.u8(static_cast<std::uint8_t>(BodyForm::Deferred));
+                    out.u64(bodies.out.size());
+                    block(bodies, func->body);
+                } else {
+                    out.u8(static_cast<std::uint8_t>(BodyForm::Inline));
+                    block(out, func->body);
+                }
+                break;
+            }
+            default: {
+                auto* import = cast<ModuleImport>(stmt);
+                out.text(import->path);
+                symbol(out, import->alias);
+                break;
+            }
+        }
+    }
+};
+
+// Rebuilds nodes in context. Anything out of range throws, so a damaged
+// file fails cleanly instead of producing a bad tree.
+class Decoder {
+public:
+    // Deferred top-level bodies, as offsets from the start of the body section.
+    std::vector<std::pair<FunctionDefinition*, std::uint64_t>> deferred;
+
+    Decoder(Reader& in, const std::vector<Symbol>& symbols, ASTContext& context)
+        : in(in), symbols(symbols), context(context) {}
+
+    Statement* statement() {
+        auto kind = static_cast<NodeKind>(in.u8());
+        switch (kind) {
+            case NodeKind::Block:
+                return blockContents();
+            case NodeKind::VariableDeclaration: {
+                Symbol name = symbol();
+                std::string_view type = text();
+                bool isConst = in.u8() != 0;
+                return context.make<VariableDeclaration>(name, type, isConst, expression());
+            }
+            case NodeKind::AssignmentStatement: {
+                Symbol name = symbol();
+                return context.make<AssignmentStatement>(name, expression());
+            }
+            case NodeKind::ExpressionStatement:
+                return context.make<ExpressionStatement>(expression());
+            case NodeKind::Return:
+                return context.make<ReturnStatement>(expression());
+            case NodeKind::If: {
+                auto* stmt = context.make<IfStatement>();
+                stmt->condition = expression();
+                stmt->thenBranch = block();
+                stmt->elseBranch = block();
+                return stmt;
+            }
+            case NodeKind::For: {
+                auto* stmt = context.make<ForStatement>();
+                stmt->iterator = symbol();
+                stmt->start = expression();
+                stmt->end = expression();
+                stmt->body = block();
+                return stmt;
+            }
+            case NodeKind::While: {
+                auto* stmt = context.make<WhileStatement>();
+                stmt->condition = expression();
+                stmt->body = block();
+                return stmt;
+            }
+            case NodeKind::Print: {
+                std::string_view format = text();
+                bool formatted = in.u8() != 0;
+                return context.make<PrintStatement>(format, expressions(), formatted);
+            }
+            case NodeKind::Gather: {
+                auto* stmt = context.make<GatherStatement>();
+                std::vector<Symbol> names(in.count(sizeof(std::uint32_t)));
+                for (Symbol& name : names) name = symbol();
+                stmt->names = context.list(names);
+                return stmt;
+            }
+            case NodeKind::FunctionDefinition: {
+                auto* func = context.make<FunctionDefinition>();
+                func->name = symbol();
+                func->returnType = text();
+                std::vector<Parameter> params(in.count(2 * sizeof(std::uint32_t)));
+                for (Parameter& param : params) {
+                    param.type = text();
+                    param.name = symbol();
+                }
+                func->parameters = context.list(params);
+                auto form = static_cast<BodyForm>(in.u8());
+                if (form == BodyForm::Deferred) deferred.emplace_back(func, in.u64());
+                else if (form == BodyForm::Inline) func->body = block();
+                else throw std::runtime_error("bad function body in module interface");
+                return func;
+            }
+            case NodeKind::ModuleImport: {
+                auto* import = context.make<ModuleImport>();
+                import->path = text();
+                import->alias = symbol();
+                return import;
+            }
+            default:
+                throw std::runtime_error("bad statement in module interface");
+        }
+    }
+
+    BlockStatement* block() {
+        std::uint8_t kind = in.u8();
+        if (kind == NullNode) return nullptr;
+        if (kind != static_cast<std::uint8_t>(NodeKind::Block)) throw std::runtime_error("bad block in module interface");
+        return blockContents();
+    }
+
+private:
+    Reader& in;
+    const std::vector<Symbol>& symbols;
+    ASTContext& context;
+
+    BlockStatement* blockContents() {
+        auto* blk = context.make<BlockStatement>();
+        std::vector<Statement*> statements(in.count(1));
+        for (Statement*& inner : statements) inner = statement();
+        blk->statements = context.list(statements);
+        return blk;
+    }
+
+    Symbol symbol() {
+        std::uint32_t index = in.u32();
+        if (index >= symbols.size()) throw std::runtime_error("bad symbol in module interface");
+        return symbols[index];
+    }
+
+    std::string_view text() {
+        std::string_view value = in.text();
+        return value.empty() ? std::string_view() : context.text(value);
+    }
+
+    Span<Expression*> expressions() {
+        std::vector<Expression*> list(in.count(1));
+        for (Expression*& expr : list) expr = expression();
+        return context.list(list);
+    }
+
+    Expression* expression() {
+        std::uint8_t tag = in.u8();
+        if (tag == NullNode) return nullptr;
+        switch (static_cast<NodeKind>(tag)) {
+            case NodeKind::Number:
+                return context.make<NumberExpression>(static_cast<int>(in.u32()));
+            case NodeKind::Float:
+                return context.make<FloatExpression>(in.f64());
+            case NodeKind::String:
+                return context.make<StringExpression>(text());
+            case NodeKind::Bool:
+                return context.make<BoolExpression>(in.u8() != 0);
+            case NodeKind::Variable:
+                return context.make<VariableExpression>(symbol());
+            case NodeKind::Unary: {
+                std::uint8_t op = in.u8();
+                if (op > static_cast<std::uint8_t>(UnaryOp::Negate)) break;
+                return context.make<UnaryExpression>(static_cast<UnaryOp>(op), expression());
+            }
+            case NodeKind::Binary: {
+                std::uint8_t op = in.u8();
+                if (op > static_cast<std::uint8_t>(BinaryOp::Divide)) break;
+                Expression* left = expression();
+                return context.make<BinaryExpression>(left, static_cast<BinaryOp>(op), expression());
+            }
+            case NodeKind::Assignment: {
+                Symbol name = symbol();
+                return context.make<AssignmentExpression>(name, expression());
+            }
+            case NodeKind::Call: {
+                Symbol name = symbol();
+                Symbol ns = symbol();
+                return context.make<CallExpression>(name, expressions(), ns);
+            }
+            default:
+                break;
+        }
+        throw std::runtime_error("bad expression in module interface");
+    }
+};
+
+} // namespace
+
+std::string ModuleInterface::encode(const std::vector<Statement*>& statements, std::uint64_t contentHash) {
+    Encoder encoder;
+    for (Statement* stmt : statements) encoder.topLevel(stmt);
+
+    Writer out;
+    out.text(std::string_view(Magic, sizeof Magic));
+    out.u32(FormatVersion);
+    out.text(compilerStamp());
+    out.u64(contentHash);
+    out.u32(static_cast<std::uint32_t>(encoder.symbols.size()));
+    for (Symbol symbol : encoder.symbols) out.text(symbolName(symbol));
+    out.u32(static_cast<std::uint32_t>(statements.size()));
+    out.out += encoder.decls.out;
+    out.out += encoder.bodies.out;
+    return std::move(out.out);
+}
+
+std::unique_ptr<ModuleInterface> ModuleInterface::decode(std::string bytes, std::uint64_t contentHash,
+                                                         ASTContext& context,
+                                                         std::vector<Statement*>& statements) {
+    std::unique_ptr<ModuleInterface> interface(new ModuleInterface());
+    interface->bytes = std::move(bytes);
+    try {
+        Reader in(interface->bytes);
+        if (in.text() != std::string_view(Magic, sizeof Magic) || in.u32() != FormatVersion ||
+            in.text() != compilerStamp() || in.u64() != contentHash) {
+            return nullptr;
+        }
+        interface->symbols.resize(in.count(sizeof(std::uint32_t)));
+        for (Symbol& symbol : interface->symbols) symbol = intern(in.text());
+
+        Decoder decoder(in, interface->symbols, context);
+        std::vector<Statement*> decoded(in.count(1));
+        for (Statement*& stmt : decoded) stmt = decoder.statement();
+        size_t bodySection = in.offset();
+        for (const auto& body : decoder.deferred) {
+            if (body.second >= interface->bytes.size() - bodySection) return nullptr;
+            interface->bodies.emplace(body.first, bodySection + body.second);
+        }
+        statements = std::move(decoded);
+    } catch (const std::runtime_error&) {
+        return nullptr;
+    }
+    return interface;
+}
+
+std::uint64_t ModuleInterface::structuralHash(FunctionDefinition* func) {
+    Encoder encoder;
+    encoder.nested(func);
+    std::uint64_t hash = fnv1a(encoder.decls.out);
+    for (Symbol symbol : encoder.symbols) {
+        hash = fnv1a(symbolName(symbol), fnv1a(std::string_view("\0", 1), hash));
+    }
+    return hash;
+}
+
+bool ModuleInterface::readBody(FunctionDefinition* func, ASTContext& context) {
+    func->body = decodeBody(func, context);
+    return func->body != nullptr;
+}
+
+BlockStatement* ModuleInterface::decodeBody(const FunctionDefinition* func, ASTContext& context) {
+    auto found = bodies.find(func);
+    if (found == bodies.end()) return nullptr;
+    Reader in(bytes, found->second);
+    Decoder decoder(in, symbols, context);
+    return decoder.block();
+}
@@ -1,13 +1,17 @@
 #include "parser.hpp"
+#include "thread_pool.hpp"
 
-#include <stdexcept>
+#include <array>
+#include <charconv>
+#include <deque>
+#include <future>
 #include <utility>
 
-Parser::Parser(const std::vector<Token>& tokens, ErrorHandler& handler)
-    : tokens(tokens), pos(0), errorHandler(handler) {}
+Parser::Parser(Lexer& lexer, ErrorHandler& handler, ASTContext& context)
+    : tokens(lexer), previousType(TokenType::Unknown), errorHandler(handler), context(context) {}
 
 const Token& Parser::current() const {
-    return tokens[pos];
+    return tokens.current();
 }
 
 bool Parser::match(TokenType type) {
@@ -20,7 +24,8 @@ bool Parser::match(TokenType type) {
 
 void Parser::advance() {
     if (!isAtEnd()) {
-        pos++;
+        previousType = current().type;
+        tokens.advance();
     }
 }
 
@@ -28,46 +33,72 @@ bool Parser::isAtEnd() const {
     return current().type == TokenType::EndOfFile;
 }
 
-void Parser::expect(TokenType type, const std::string& message) {
-    if (!match(type)) {
-        errorHandler.error(current().line, current().column, message);
-        throw std::runtime_error("parse error");
-    }
+bool Parser::expect(TokenType type, const char* message) {
+    if (match(type)) return true;
+    errorAtCurrent(message);
+    return false;
+}
+
+void Parser::errorAtCurrent(const char* message) {
+    // Only the first error before recovery is reported; the rest would be
+    // fallout from the same mistake.
+    if (panicking) return;
+    panicking = true;
+    errorHandler.error(current().line, current().column, message);
 }
 
+// Skips to a likely statement boundary: just past a ';' or a skipped
+// '{...}' group, or before a keyword that starts a declaration, or before the
+// '}' closing the enclosing block. Braces opened while skipping are matched so
+// a broken statement's body is skipped whole. At least one token is consumed
+// unless a stop token is already current, so recovery always makes progress.
 void Parser::synchronize() {
+    panicking = false;
+    operands.clear();
+    operators.clear();
+    int nested = 0;
+    bool skipped = false;
     while (!isAtEnd()) {
-        if (tokens[pos - 1].type == TokenType::Semicolon) return;
-        switch (current().type) {
-            case TokenType::Fx:
-            case TokenType::Var:
-            case TokenType::Const:
-            case TokenType::If:
-            case TokenType::For:
-            case TokenType::While:
-            case TokenType::Return:
-                return;
-            default:
-                break;
+        if (skipped && nested == 0 &&
+            (previousType == TokenType::Semicolon || previousType == TokenType::RightBrace)) {
+            return;
+        }
+        TokenType type = current().type;
+        if (nested == 0) {
+            switch (type) {
+                case TokenType::Fx:
+                case TokenType::Var:
+                case TokenType::Const:
+                case TokenType::If:
+                case TokenType::For:
+                case TokenType::While:
+                case TokenType::Return:
+                    return;
+                case TokenType::RightBrace:
+                    if (blockDepth > 0) return;
+                    break;
+                default:
+                    break;
+            }
         }
+        if (type == TokenType::LeftBrace) ++nested;
+        else if (type == TokenType::RightBrace && nested > 0) --nested;
         advance();
+        skipped = true;
     }
 }
 
-std::vector<std::unique_ptr<Statement>> Parser::parseProgram() {
-    std::vector<std::unique_ptr<Statement>> program;
+std::vector<Statement*> Parser::parseProgram() {
+    std::vector<Statement*> program;
     while (!isAtEnd()) {
-        try {
-            auto decl = declaration();
-            if (decl) program.push_back(std::move(decl));
-        } catch (...) {
-            synchronize();
-        }
+        auto decl = declaration();
+        if (decl) program.push_back(decl);
+        else if (panicking) synchronize();
     }
     return program;
 }
 
-std::unique_ptr<Statement> Parser::declaration() {
+Statement* Parser::declaration() {
     if (match(TokenType::Mod)) return moduleImport();
     if (match(TokenType::Fx)) return functionDefinition();
     if (match(TokenType::Var)) return varDeclaration(false);
@@ -75,69 +106,69 @@ std::unique_ptr<Statement> Parser::declaration() {
     return statement();
 }
 
-std::unique_ptr<Statement> Parser::moduleImport() {
-    expect(TokenType::LeftParen, "expected '(' after mod");
+Statement* Parser::moduleImport() {
+    if (!expect(TokenType::LeftParen, "expected '(' after mod")) return nullptr;
     if (current().type != TokenType::String) {
-        errorHandler.error(current().line, current().column, "expected string path in module import");
-        throw std::runtime_error("parse error");
+        errorAtCurrent("expected string path in module import");
+        return nullptr;
     }
-    std::string path = current().lexeme;
+    std::string_view path = context.text(current().lexeme);
     advance();
-    expect(TokenType::RightParen, "expected ')' after module path");
-    expect(TokenType::ColonColon, "expected '::' for module alias");
+    if (!expect(TokenType::RightParen, "expected ')' after module path")) return nullptr;
+    if (!expect(TokenType::ColonColon, "expected '::' for module alias")) return nullptr;
     if (current().type != TokenType::Identifier) {
-        errorHandler.error(current().line, current().column, "expected module alias identifier");
-        throw std::runtime_error("parse error");
+        errorAtCurrent("expected module alias identifier");
+        return nullptr;
     }
-    std::string alias = current().lexeme;
+    Symbol alias = current().symbol;
     advance();
-    expect(TokenType::Semicolon, "expected ';' after module import");
-    auto stmt = std::make_unique<ModuleImport>();
+    if (!expect(TokenType::Semicolon, "expected ';' after module import")) return nullptr;
+    auto stmt = context.make<ModuleImport>();
     stmt->path = path;
     stmt->alias = alias;
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::functionDefinition() {
+Statement* Parser::functionDefinition() {
     if (current().type != TokenType::Identifier) {
-        errorHandler.error(current().line, current().column, "expected function name");
-        throw std::runtime_error("parse error");
+        errorAtCurrent("expected function name");
+        return nullptr;
     }
-    std::string name = current().lexeme;
+    Symbol name = current().symbol;
     advance();
-    expect(TokenType::LeftParen, "expected '(' after function name");
+    if (!expect(TokenType::LeftParen, "expected '(' after function name")) return nullptr;
     std::vector<Parameter> params;
     if (!match(TokenType::RightParen)) {
         do {
             if (current().type != TokenType::Identifier) {
-                errorHandler.error(current().line, current().column, "expected parameter type");
-                throw std::runtime_error("parse error");
+                errorAtCurrent("expected parameter type");
+                return nullptr;
             }
             Parameter param;
-            param.type = current().lexeme;
+            param.type = symbolName(current().symbol);
             advance();
             if (match(TokenType::Colon)) {
                 if (current().type != TokenType::Identifier) {
-                    errorHandler.error(current().line, current().column, "expected parameter name");
-                    throw std::runtime_error("parse error");
+                    errorAtCurrent("expected parameter name");
+                    return nullptr;
                 }
-                param.name = current().lexeme;
+                param.name = current().symbol;
                 advance();
             } else {
-                param.name = "p" + std::to_string(params.size());
+                param.name = intern("p" + std::to_string(params.size()));
             }
             params.push_back(param);
         } while (match(TokenType::Comma));
-        expect(TokenType::RightParen, "expected ')' after parameters");
+        if (!expect(TokenType::RightParen, "expected ')' after parameters")) return nullptr;
     }
 
-    std::string returnType = "void";
+    std::string_view returnType = "void";
     if (match(TokenType::Arrow)) {
         if (current().type != TokenType::Identifier) {
-            errorHandler.error(current().line, current().column, "expected return type");
-            throw std::runtime_error("parse error");
+            errorAtCurrent("expected return type");
+            return nullptr;
         }
-        returnType = current().lexeme;
+        returnType = symbolName(current().symbol);
         advance();
     }
 
@@ -145,297 +176,458 @@ std::unique_ptr<Statement> Parser::functionDefinition() {
         // Prototype only; skip emitting a body
         return nullptr;
     }
-    auto body = block();
-    auto func = std::make_unique<FunctionDefinition>();
+    auto func = context.make<FunctionDefinition>();
     func->name = name;
     func->returnType = returnType;
-    func->parameters = std::move(params);
-    func->body = std::move(body);
+    func->parameters = context.list(params);
+    if (lazyBodies) {
+        if (current().type != TokenType::LeftBrace) {
+            errorAtCurrent("expected '{'");
+            return nullptr;
+        }
+        const char* start = current().lexeme.data();
+        func->deferredLine = current().line;
+        const char* end = tokens.skipBlock();
+        if (!end) {
+            errorAtCurrent("expected '}'");
+            return nullptr;
+        }
+        previousType = TokenType::RightBrace;
+        func->deferredBody = std::string_view(start, static_cast<size_t>(end - start));
+        return func;
+    }
+    func->body = block();
+    if (!func->body) return nullptr;
     return func;
 }
 
-std::unique_ptr<Statement> Parser::varDeclaration(bool isConst) {
-    std::string type;
+bool Parser::parseDeferredBody(FunctionDefinition* func, std::string_view source,
+                               ErrorHandler& handler, ASTContext& context) {
+    func->body = parseDeferredBlock(func, source, handler, context);
+    return func->body != nullptr;
+}
+
+BlockStatement* Parser::parseDeferredBlock(const FunctionDefinition* func, std::string_view source,
+                                           ErrorHandler& handler, ASTContext& context) {
+    size_t offset = static_cast<size_t>(func->deferredBody.data() - source.data());
+    Lexer lexer(source, {offset, func->deferredLine}, offset + func->deferredBody.size());
+    Parser parser(lexer, handler, context);
+    return parser.block();
+}
+
+Statement* Parser::varDeclaration(bool isConst) {
+    std::string_view type;
     if (match(TokenType::ColonColon)) {
         if (current().type != TokenType::Identifier) {
-            errorHandler.error(current().line, current().column, "expected type after '::'");
-            throw std::runtime_error("parse error");
+            errorAtCurrent("expected type after '::'");
+            return nullptr;
         }
-        type = current().lexeme;
+        type = symbolName(current().symbol);
         advance();
     }
     if (current().type != TokenType::Identifier) {
-        errorHandler.error(current().line, current().column, "expected variable name");
-        throw std::runtime_error("parse error");
+        errorAtCurrent("expected variable name");
+        return nullptr;
     }
-    std::string name = current().lexeme;
+    Symbol name = current().symbol;
     advance();
-    std::unique_ptr<Expression> init;
+    Expression* init = nullptr;
     if (match(TokenType::Assign)) {
         init = expression();
+        if (!init) return nullptr;
     }
-    expect(TokenType::Semicolon, "expected ';' after variable declaration");
-    return std::make_unique<VariableDeclaration>(name, type, isConst, std::move(init));
+    if (!expect(TokenType::Semicolon, "expected ';' after variable declaration")) return nullptr;
+    return context.make<VariableDeclaration>(name, type, isConst, init);
 }
 
-std::unique_ptr<BlockStatement> Parser::block() {
-    expect(TokenType::LeftBrace, "expected '{'");
-    auto blk = std::make_unique<BlockStatement>();
+BlockStatement* Parser::block() {
+    if (!expect(TokenType::LeftBrace, "expected '{'")) return nullptr;
+    std::vector<Statement*> statements;
+    ++blockDepth;
     while (!isAtEnd() && current().type != TokenType::RightBrace) {
         auto stmt = declaration();
-        if (stmt) blk->statements.push_back(std::move(stmt));
+        if (stmt) statements.push_back(stmt);
+        else if (panicking) synchronize();
     }
-    expect(TokenType::RightBrace, "expected '}'");
+    --blockDepth;
+    if (!expect(TokenType::RightBrace, "expected '}'")) return nullptr;
+    auto blk = context.make<BlockStatement>();
+    blk->statements = context.list(statements);
     return blk;
 }
 
-std::unique_ptr<Statement> Parser::statement() {
+Statement* Parser::statement() {
     if (match(TokenType::If)) return ifStatement();
     if (match(TokenType::For)) return forStatement();
     if (match(TokenType::While)) return whileStatement();
     if (match(TokenType::Return)) return returnStatement();
     if (match(TokenType::Print)) return printStatement();
     if (match(TokenType::Gather)) return gatherStatement();
-    if (match(TokenType::LeftBrace)) {
-        pos--; // rewind so block() can consume '{'
-        return block();
-    }
+    if (current().type == TokenType::LeftBrace) return block();
 
     auto expr = expression();
-    expect(TokenType::Semicolon, "expected ';' after expression");
-    return std::make_unique<ExpressionStatement>(std::move(expr));
+    if (!expr || !expect(TokenType::Semicolon, "expected ';' after expression")) return nullptr;
+    return context.make<ExpressionStatement>(expr);
 }
 
-std::unique_ptr<Statement> Parser::ifStatement() {
-    expect(TokenType::LeftParen, "expected '(' after if");
+Statement* Parser::ifStatement() {
+    if (!expect(TokenType::LeftParen, "expected '(' after if")) return nullptr;
     auto cond = expression();
-    expect(TokenType::RightParen, "expected ')' after condition");
+    if (!cond || !expect(TokenType::RightParen, "expected ')' after condition")) return nullptr;
     auto thenBranch = block();
-    std::unique_ptr<BlockStatement> elseBranch;
+    if (!thenBranch) return nullptr;
+    BlockStatement* elseBranch = nullptr;
     if (match(TokenType::Else)) {
         elseBranch = block();
+        if (!elseBranch) return nullptr;
     }
-    auto stmt = std::make_unique<IfStatement>();
-    stmt->condition = std::move(cond);
-    stmt->thenBranch = std::move(thenBranch);
-    stmt->elseBranch = std::move(elseBranch);
+    auto stmt = context.make<IfStatement>();
+    stmt->condition = cond;
+    stmt->thenBranch = thenBranch;
+    stmt->elseBranch = elseBranch;
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::forStatement() {
+Statement* Parser::forStatement() {
     if (current().type != TokenType::Identifier) {
-        errorHandler.error(current().line, current().column, "expected iterator name");
-        throw std::runtime_error("parse error");
+        errorAtCurrent("expected iterator name");
+        return nullptr;
     }
-    std::string iterator = current().lexeme;
+    Symbol iterator = current().symbol;
     advance();
-    expect(TokenType::In, "expected 'in' after iterator");
+    if (!expect(TokenType::In, "expected 'in' after iterator")) return nullptr;
     auto start = expression();
-    expect(TokenType::DotDot, "expected '..' in range");
+    if (!start || !expect(TokenType::DotDot, "expected '..' in range")) return nullptr;
     auto end = expression();
+    if (!end) return nullptr;
     auto bodyBlock = block();
-    auto stmt = std::make_unique<ForStatement>();
+    if (!bodyBlock) return nullptr;
+    auto stmt = context.make<ForStatement>();
     stmt->iterator = iterator;
-    stmt->start = std::move(start);
-    stmt->end = std::move(end);
-    stmt->body = std::move(bodyBlock);
+    stmt->start = start;
+    stmt->end = end;
+    stmt->body = bodyBlock;
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::whileStatement() {
-    expect(TokenType::LeftParen, "expected '(' after while");
+Statement* Parser::whileStatement() {
+    if (!expect(TokenType::LeftParen, "expected '(' after while")) return nullptr;
     auto cond = expression();
-    expect(TokenType::RightParen, "expected ')' after condition");
+    if (!cond || !expect(TokenType::RightParen, "expected ')' after condition")) return nullptr;
     auto bodyBlock = block();
-    auto stmt = std::make_unique<WhileStatement>();
-    stmt->condition = std::move(cond);
-    stmt->body = std::move(bodyBlock);
+    if (!bodyBlock) return nullptr;
+    auto stmt = context.make<WhileStatement>();
+    stmt->condition = cond;
+    stmt->body = bodyBlock;
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::returnStatement() {
-    std::unique_ptr<Expression> expr;
+Statement* Parser::returnStatement() {
+    Expression* expr = nullptr;
     if (current().type != TokenType::Semicolon) {
         expr = expression();
+        if (!expr) return nullptr;
     }
-    expect(TokenType::Semicolon, "expected ';' after return");
-    return std::make_unique<ReturnStatement>(std::move(expr));
+    if (!expect(TokenType::Semicolon, "expected ';' after return")) return nullptr;
+    return context.make<ReturnStatement>(expr);
 }
 
-std::unique_ptr<Statement> Parser::printStatement() {
-    expect(TokenType::LeftParen, "expected '(' after print");
-    std::vector<std::unique_ptr<Expression>> args;
+Statement* Parser::printStatement() {
+    if (!expect(TokenType::LeftParen, "expected '(' after print")) return nullptr;
+    std::vector<Expression*> args;
     if (!match(TokenType::RightParen)) {
         do {
-            args.push_back(expression());
+            auto arg = expression();
+            if (!arg) return nullptr;
+            args.push_back(arg);
         } while (match(TokenType::Comma));
-        expect(TokenType::RightParen, "expected ')' after print arguments");
+        if (!expect(TokenType::RightParen, "expected ')' after print arguments")) return nullptr;
     }
-    expect(TokenType::Semicolon, "expected ';' after print");
+    if (!expect(TokenType::Semicolon, "expected ';' after print")) return nullptr;
 
     bool formatted = false;
-    std::string fmt;
-    std::vector<std::unique_ptr<Expression>> realArgs;
+    std::string_view fmt;
+    std::vector<Expression*> realArgs;
     if (!args.empty()) {
-        if (auto* str = dynamic_cast<StringExpression*>(args[0].get())) {
+        if (auto* str = dyn_cast<StringExpression>(args[0])) {
             formatted = true;
             fmt = str->value;
             for (size_t i = 1; i < args.size(); ++i) {
-                realArgs.push_back(std::move(args[i]));
+                realArgs.push_back(args[i]);
             }
         } else {
             fmt = "{}";
-            realArgs.push_back(std::move(args[0]));
+            realArgs.push_back(args[0]);
         }
     }
-    return std::make_unique<PrintStatement>(fmt, std::move(realArgs), formatted);
+    return context.make<PrintStatement>(fmt, context.list(realArgs), formatted);
 }
 
-std::unique_ptr<Statement> Parser::gatherStatement() {
-    expect(TokenType::LeftParen, "expected '(' after gather");
-    std::vector<std::string> names;
+Statement* Parser::gatherStatement() {
+    if (!expect(TokenType::LeftParen, "expected '(' after gather")) return nullptr;
+    std::vector<Symbol> names;
     if (!match(TokenType::RightParen)) {
         do {
             if (current().type != TokenType::Identifier) {
-                errorHandler.error(current().line, current().column, "expected identifier in gather");
-                throw std::runtime_error("parse error");
+                errorAtCurrent("expected identifier in gather");
+                return nullptr;
             }
-            names.push_back(current().lexeme);
+            names.push_back(current().symbol);
             advance();
         } while (match(TokenType::Comma));
-        expect(TokenType::RightParen, "expected ')' after gather list");
+        if (!expect(TokenType::RightParen, "expected ')' after gather list")) return nullptr;
     }
-    expect(TokenType::Semicolon, "expected ';' after gather");
-    auto stmt = std::make_unique<GatherStatement>();
-    stmt->names = std::move(names);
+    if (!expect(TokenType::Semicolon, "expected ';' after gather")) return nullptr;
+    auto stmt = context.make<GatherStatement>();
+    stmt->names = context.list(names);
     return stmt;
 }
 
-std::unique_ptr<Expression> Parser::expression() {
-    return assignment();
+namespace {
+
+struct BinaryRule {
+    Precedence precedence;
+    BinaryOp op;
+};
+
+constexpr size_t TokenTypeCount = static_cast<size_t>(TokenType::Unknown) + 1;
+
+// Infix operators by token type; Precedence::None marks every other token.
+// Assign is listed for its precedence only, its op is unused.
+constexpr std::array<BinaryRule, TokenTypeCount> makeBinaryRules() {
+    std::array<BinaryRule, TokenTypeCount> rules{};
+    auto set = [&rules](TokenType type, Precedence precedence, BinaryOp op) {
+        rules[static_cast<size_t>(type)] = {precedence, op};
+    };
+    set(TokenType::Assign, Precedence::Assignment, BinaryOp::Equal);
+    set(TokenType::Equals, Precedence::Comparison, BinaryOp::Equal);
+    set(TokenType::NotEquals, Precedence::Comparison, BinaryOp::NotEqual);
+    set(TokenType::Less, Precedence::Comparison, BinaryOp::Less);
+    set(TokenType::LessEq, Precedence::Comparison, BinaryOp::LessEqual);
+    set(TokenType::Greater, Precedence::Comparison, BinaryOp::Greater);
+    set(TokenType::GreaterEq, Precedence::Comparison, BinaryOp::GreaterEqual);
+    set(TokenType::Plus, Precedence::Term, BinaryOp::Add);
+    set(TokenType::Minus, Precedence::Term, BinaryOp::Subtract);
+    set(TokenType::Star, Precedence::Factor, BinaryOp::Multiply);
+    set(TokenType::Slash, Precedence::Factor, BinaryOp::Divide);
+    return rules;
 }
 
-std::unique_ptr<Expression> Parser::assignment() {
-    auto expr = comparison();
-    if (match(TokenType::Assign)) {
-        if (auto* var = dynamic_cast<VariableExpression*>(expr.get())) {
-            std::string name = var->name;
-            auto value = assignment();
-            return std::make_unique<AssignmentExpression>(name, std::move(value));
-        }
-        errorHandler.error(current().line, current().column, "invalid assignment target");
-        throw std::runtime_error("parse error");
-    }
-    return expr;
+constexpr auto binaryRules = makeBinaryRules();
+
+const BinaryRule& binaryRule(TokenType type) {
+    return binaryRules[static_cast<size_t>(type)];
 }
 
-std::unique_ptr<Expression> Parser::comparison() {
-    auto expr = term();
+} // namespace
+
+// Operator-precedence loop: prefix operators and '(' are pushed as pending
+// operators, each atom is pushed as an operand, and an infix operator first
+// reduces everything on the stack that binds at least as tightly (left
+// associative) or strictly tighter (assignment, right associative).
+Expression* Parser::expression() {
+    const size_t operandBase = operands.size();
+    const size_t operatorBase = operators.size();
+    int openGroups = 0;
+    auto abandon = [&] {
+        operands.resize(operandBase);
+        operators.resize(operatorBase);
+        return nullptr;
+    };
+
     while (true) {
-        TokenType t = current().type;
-        if (t == TokenType::Equals || t == TokenType::NotEquals ||
-            t == TokenType::Less || t == TokenType::LessEq ||
-            t == TokenType::Greater || t == TokenType::GreaterEq) {
-            std::string op = current().lexeme;
-            advance();
-            auto right = term();
-            expr = std::make_unique<BinaryExpression>(std::move(expr), op, std::move(right));
-        } else break;
-    }
-    return expr;
-}
+        while (true) {
+            if (match(TokenType::Minus)) {
+                operators.push_back({PendingOperator::Form::Negate, Precedence::Prefix, BinaryOp::Equal, NoSymbol});
+            } else if (match(TokenType::LeftParen)) {
+                operators.push_back({PendingOperator::Form::Group, Precedence::None, BinaryOp::Equal, NoSymbol});
+                ++openGroups;
+            } else {
+                break;
+            }
+        }
+        Expression* atom = primary();
+        if (!atom) return abandon();
+        operands.push_back(atom);
+
+        while (openGroups > 0 && match(TokenType::RightParen)) {
+            reduce(operatorBase, Precedence::Assignment);
+            operators.pop_back();
+            --openGroups;
+        }
 
-std::unique_ptr<Expression> Parser::term() {
-    auto expr = factor();
-    while (current().type == TokenType::Plus || current().type == TokenType::Minus) {
-        std::string op = current().lexeme;
-        advance();
-        auto right = factor();
-        expr = std::make_unique<BinaryExpression>(std::move(expr), op, std::move(right));
-    }
-    return expr;
-}
+        const BinaryRule& rule = binaryRule(current().type);
+        if (rule.precedence == Precedence::None) break;
 
-std::unique_ptr<Expression> Parser::factor() {
-    auto expr = unary();
-    while (current().type == TokenType::Star || current().type == TokenType::Slash) {
-        std::string op = current().lexeme;
-        advance();
-        auto right = unary();
-        expr = std::make_unique<BinaryExpression>(std::move(expr), op, std::move(right));
+        if (current().type == TokenType::Assign) {
+            reduce(operatorBase, Precedence::Comparison);
+            advance();
+            auto* var = dyn_cast<VariableExpression>(operands.back());
+            if (!var) {
+                errorAtCurrent("invalid assignment target");
+                return abandon();
+            }
+            operands.pop_back();
+            operators.push_back({PendingOperator::Form::Assign, Precedence::Assignment, BinaryOp::Equal, var->name});
+        } else {
+            reduce(operatorBase, rule.precedence);
+            advance();
+            operators.push_back({PendingOperator::Form::Binary, rule.precedence, rule.op, NoSymbol});
+        }
     }
-    return expr;
-}
 
-std::unique_ptr<Expression> Parser::unary() {
-    if (match(TokenType::Minus)) {
-        auto operand = unary();
-        return std::make_unique<UnaryExpression>("-", std::move(operand));
+    if (openGroups > 0) {
+        errorAtCurrent("expected ')'");
+        return abandon();
     }
-    return call();
+    reduce(operatorBase, Precedence::Assignment);
+    Expression* result = operands.back();
+    operands.resize(operandBase);
+    return result;
 }
 
-std::unique_ptr<Expression> Parser::call() {
-    auto expr = primary();
-    return expr;
+void Parser::reduce(size_t operatorBase, Precedence minimum) {
+    while (operators.size() > operatorBase && operators.back().precedence >= minimum) {
+        PendingOperator pending = operators.back();
+        operators.pop_back();
+        Expression* right = operands.back();
+        operands.pop_back();
+        switch (pending.form) {
+            case PendingOperator::Form::Negate:
+                operands.push_back(context.make<UnaryExpression>(UnaryOp::Negate, right));
+                break;
+            case PendingOperator::Form::Assign:
+                operands.push_back(context.make<AssignmentExpression>(pending.target, right));
+                break;
+            default: {
+                Expression* left = operands.back();
+                operands.back() = context.make<BinaryExpression>(left, pending.op, right);
+                break;
+            }
+        }
+    }
 }
 
-std::unique_ptr<Expression> Parser::primary() {
+Expression* Parser::primary() {
     if (current().type == TokenType::Number) {
-        int value = std::stoi(current().lexeme);
+        std::string_view text = current().lexeme;
+        int value = 0;
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != std::errc()) {
+            errorAtCurrent("integer literal out of range");
+            return nullptr;
+        }
         advance();
-        return std::make_unique<NumberExpression>(value);
+        return context.make<NumberExpression>(value);
     }
     if (current().type == TokenType::Float) {
-        double value = std::stod(current().lexeme);
+        std::string_view text = current().lexeme;
+        double value = 0.0;
+        std::from_chars(text.data(), text.data() + text.size(), value);
         advance();
-        return std::make_unique<FloatExpression>(value);
+        return context.make<FloatExpression>(value);
     }
     if (current().type == TokenType::String) {
-        std::string value = current().lexeme;
+        std::string_view value = context.text(current().lexeme);
         advance();
-        return std::make_unique<StringExpression>(value);
+        return context.make<StringExpression>(value);
     }
     if (current().type == TokenType::True || current().type == TokenType::False) {
         bool v = current().type == TokenType::True;
         advance();
-        return std::make_unique<BoolExpression>(v);
+        return context.make<BoolExpression>(v);
     }
     if (current().type == TokenType::Identifier) {
-        std::string name = current().lexeme;
+        Symbol name = current().symbol;
         advance();
-        std::string ns;
+        Symbol ns = NoSymbol;
         if (match(TokenType::Dot)) {
             if (current().type != TokenType::Identifier) {
-                errorHandler.error(current().line, current().column, "expected member after '.'");
-                throw std::runtime_error("parse error");
+                errorAtCurrent("expected member after '.'");
+                return nullptr;
             }
             ns = name;
-            name = current().lexeme;
+            name = current().symbol;
             advance();
         }
         if (match(TokenType::LeftParen)) {
-            std::vector<std::unique_ptr<Expression>> args;
+            std::vector<Expression*> args;
             if (!match(TokenType::RightParen)) {
                 do {
-                    args.push_back(expression());
+                    auto arg = expression();
+                    if (!arg) return nullptr;
+                    args.push_back(arg);
                 } while (match(TokenType::Comma));
-                expect(TokenType::RightParen, "expected ')' after arguments");
+                if (!expect(TokenType::RightParen, "expected ')' after arguments")) return nullptr;
             }
-            return std::make_unique<CallExpression>(name, std::move(args), ns);
+            return context.make<CallExpression>(name, context.list(args), ns);
         }
-        if (!ns.empty()) {
-            errorHandler.error(current().line, current().column, "namespaced value must be a call");
-            throw std::runtime_error("parse error");
+        if (ns != NoSymbol) {
+            errorAtCurrent("namespaced value must be a call");
+            return nullptr;
         }
-        return std::make_unique<VariableExpression>(name);
+        return context.make<VariableExpression>(name);
     }
-    if (match(TokenType::LeftParen)) {
-        auto expr = expression();
-        expect(TokenType::RightParen, "expected ')'");
-        return expr;
+    errorAtCurrent("unexpected token");
+    return nullptr;
+}
+
+namespace {
+
+// Below this the splitting pre-pass costs more than the parallelism saves.
+constexpr size_t ParallelThreshold = 64 * 1024;
+
+// One contiguous run of top-level declarations, parsed on its own.
+struct Piece {
+    SourceOffset begin;
+    size_t end;
+    ASTContext context;
+    ErrorHandler errors;
+    std::vector<Statement*> statements;
+
+    Piece(SourceOffset b, size_t e, ErrorHandler&& handler)
+        : begin(b), end(e), errors(std::move(handler)) {}
+};
+
+} // namespace
+
+std::vector<Statement*> parseSource(std::string_view source, ErrorHandler& handler, ASTContext& context,
+                                    ThreadPool* pool) {
+    if (!pool || pool->size() < 2 || source.size() < ParallelThreshold) {
+        Lexer lexer(source);
+        Parser parser(lexer, handler, context);
+        return parser.parseProgram();
+    }
+
+    // Aim for a few pieces per worker so uneven functions still balance.
+    std::vector<SourceOffset> starts = Lexer::topLevelFunctions(source);
+    size_t target = source.size() / (pool->size() * 4) + 1;
+    std::deque<Piece> pieces;
+    SourceOffset begin{0, 1};
+    for (const SourceOffset& start : starts) {
+        if (start.offset - begin.offset >= target) {
+            pieces.emplace_back(begin, start.offset, handler.forSameFile());
+            begin = start;
+        }
     }
+    pieces.emplace_back(begin, source.size(), handler.forSameFile());
 
-    errorHandler.error(current().line, current().column, "unexpected token");
-    throw std::runtime_error("parse error");
+    std::vector<std::future<void>> pending;
+    pending.reserve(pieces.size());
+    for (Piece& piece : pieces) {
+        pending.push_back(pool->submit([&piece, source] {
+            Lexer lexer(source, piece.begin, piece.end);
+            Parser parser(lexer, piece.errors, piece.context);
+            piece.statements = parser.parseProgram();
+        }));
+    }
+    for (auto& result : pending) result.get();
+
+    std::vector<Statement*> program;
+    for (Piece& piece : pieces) {
+        program.insert(program.end(), piece.statements.begin(), piece.statements.end());
+        handler.merge(std::move(piece.errors));
+        context.adopt(std::move(piece.context));
+    }
+    return program;
 }
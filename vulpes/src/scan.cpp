@@ -0,0 +1,218 @@
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define VULPES_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan {
+namespace {
+// Scalar kernels; also used for the tails of the vector kernels.
+const char* skipWhitespaceScalar(const char* p, const char* end, int& newlines, const char*& lastNewline) {
+    while (p < end && isWhitespace(static_cast<unsigned char>(*p))) {
+        if (*p == '\n') {
+            newlines++;
+            lastNewline = p;
+        }
+        p++;
+    }
+    return p;
+}
+
+const char* findLineEndScalar(const char* p, const char* end) {
+    while (p < end && *p != '\n') p++;
+    return p;
+}
+
+const char* skipIdentifierScalar(const char* p, const char* end) {
+    while (p < end && isIdentifierChar(static_cast<unsigned char>(*p))) p++;
+    return p;
+}
+
+const char* findStringStopScalar(const char* p, const char* end) {
+    while (p < end && *p != '"' && *p != '\\' && *p != '\n') p++;
+    return p;
+}
+
+#ifdef VULPES_SCAN_X86
+// SSE2 is part of the x86-64 baseline. Each helper returns a 16-bit mask
+// with one bit per byte of the block.
+
+// Unsigned x <= limit, per byte.
+inline __m128i lessEqual16(__m128i x, __m128i limit) {
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, limit), x);
+}
+
+inline unsigned whitespaceMask16(__m128i block) {
+    __m128i space = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    __m128i control = lessEqual16(_mm_sub_epi8(block, _mm_set1_epi8('\t')), _mm_set1_epi8('\r' - '\t'));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(space, control)));
+}
+
+inline unsigned identifierMask16(__m128i block) {
+    __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+    __m128i alpha = lessEqual16(_mm_sub_epi8(lower, _mm_set1_epi8('a')), _mm_set1_epi8('z' - 'a'));
+    __m128i digit = lessEqual16(_mm_sub_epi8(block, _mm_set1_epi8('0')), _mm_set1_epi8(9));
+    __m128i under = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under)));
+}
+
+inline unsigned byteMask16(__m128i block, char c) {
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c))));
+}
+
+inline int highestBit(unsigned mask) {
+    return 31 - __builtin_clz(mask);
+}
+
+const char* skipWhitespaceSSE2(const char* p, const char* end, int& newlines, const char*& lastNewline) {
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned stop = ~whitespaceMask16(block) & 0xFFFFu;
+        unsigned lines = byteMask16(block, '\n');
+        if (stop) lines &= (stop & -stop) - 1; // only newlines before the stop
+        if (lines) {
+            newlines += __builtin_popcount(lines);
+            lastNewline = p + highestBit(lines);
+        }
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return skipWhitespaceScalar(p, end, newlines, lastNewline);
+}
+
+const char* findLineEndSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned stop = byteMask16(block, '\n');
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return findLineEndScalar(p, end);
+}
+
+const char* skipIdentifierSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned stop = ~identifierMask16(block) & 0xFFFFu;
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return skipIdentifierScalar(p, end);
+}
+
+const char* findStringStopSSE2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned stop = byteMask16(block, '"') | byteMask16(block, '\\') | byteMask16(block, '\n');
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return findStringStopScalar(p, end);
+}
+
+// AVX2 variants handle 32-byte blocks and hand the remainder to SSE2.
+#define VULPES_AVX2 __attribute__((target("avx2")))
+
+VULPES_AVX2 inline __m256i lessEqual32(__m256i x, __m256i limit) {
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(x, limit), x);
+}
+
+VULPES_AVX2 inline unsigned byteMask32(__m256i block, char c) {
+    return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(c))));
+}
+
+VULPES_AVX2 const char* skipWhitespaceAVX2(const char* p, const char* end, int& newlines, const char*& lastNewline) {
+    while (end - p >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i space = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+        __m256i control = lessEqual32(_mm256_sub_epi8(block, _mm256_set1_epi8('\t')), _mm256_set1_epi8('\r' - '\t'));
+        unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(space, control)));
+        unsigned lines = byteMask32(block, '\n');
+        if (stop) lines &= (stop & -stop) - 1;
+        if (lines) {
+            newlines += __builtin_popcount(lines);
+            lastNewline = p + highestBit(lines);
+        }
+        if (stop) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return skipWhitespaceSSE2(p, end, newlines, lastNewline);
+}
+
+VULPES_AVX2 const char* findLineEndAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned stop = byteMask32(block, '\n');
+        if (stop) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return findLineEndSSE2(p, end);
+}
+
+VULPES_AVX2 const char* skipIdentifierAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i lower = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+        __m256i alpha = lessEqual32(_mm256_sub_epi8(lower, _mm256_set1_epi8('a')), _mm256_set1_epi8('z' - 'a'));
+        __m256i digit = lessEqual32(_mm256_sub_epi8(block, _mm256_set1_epi8('0')), _mm256_set1_epi8(9));
+        __m256i under = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_'));
+        unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under)));
+        if (stop) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return skipIdentifierSSE2(p, end);
+}
+
+VULPES_AVX2 const char* findStringStopAVX2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned stop = byteMask32(block, '"') | byteMask32(block, '\\') | byteMask32(block, '\n');
+        if (stop) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return findStringStopSSE2(p, end);
+}
+
+#undef VULPES_AVX2
+#endif // VULPES_SCAN_X86
+
+struct Kernels {
+    const char* (*skipWhitespace)(const char*, const char*, int&, const char*&);
+    const char* (*findLineEnd)(const char*, const char*);
+    const char* (*skipIdentifier)(const char*, const char*);
+    const char* (*findStringStop)(const char*, const char*);
+};
+
+Kernels selectKernels() {
+#ifdef VULPES_SCAN_X86
+    __builtin_cpu_init(); // may run before libgcc's own constructor
+    if (__builtin_cpu_supports("avx2")) {
+        return {skipWhitespaceAVX2, findLineEndAVX2, skipIdentifierAVX2, findStringStopAVX2};
+    }
+    return {skipWhitespaceSSE2, findLineEndSSE2, skipIdentifierSSE2, findStringStopSSE2};
+#else
+    return {skipWhitespaceScalar, findLineEndScalar, skipIdentifierScalar, findStringStopScalar};
+#endif
+}
+
+const Kernels kernels = selectKernels();
+} // namespace
+
+const char* skipWhitespace(const char* p, const char* end, int& newlines, const char*& lastNewline) {
+    return kernels.skipWhitespace(p, end, newlines, lastNewline);
+}
+
+const char* findLineEnd(const char* p, const char* end) {
+    return kernels.findLineEnd(p, end);
+}
+
+const char* skipIdentifier(const char* p, const char* end) {
+    return kernels.skipIdentifier(p, end);
+}
+
+const char* findStringStop(const char* p, const char* end) {
+    return kernels.findStringStop(p, end);
+}
+
+} // namespace scan
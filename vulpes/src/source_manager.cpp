@@ -0,0 +1,156 @@
+#include "source_manager.hpp"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct SourceManager::File {
+    std::string path;
+    std::string canonicalPath;
+    const char* data = "";
+    size_t size = 0;
+    bool mapped = false;
+    std::string copy;         // the contents when not mapped
+    struct timespec modified = {};
+    unsigned holds = 0;
+    bool superseded = false; // a newer version of the file has its own ID
+
+    mutable std::once_flag linesBuilt;
+    mutable std::vector<size_t> lineStarts; // offset of each line's first byte
+
+    ~File() {
+        if (mapped) munmap(const_cast<char*>(data), size);
+    }
+};
+
+namespace {
+std::string canonicalize(const std::string& path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved)) return resolved;
+    return path;
+}
+} // namespace
+
+SourceManager::SourceManager(bool trackChanges) : trackChanges(trackChanges) {}
+
+SourceManager::~SourceManager() = default;
+
+FileID SourceManager::load(const std::string& path) {
+    std::string canonical = canonicalize(path);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto existing = byCanonicalPath.find(canonical);
+    struct stat info;
+    File* known = nullptr;
+    if (existing != byCanonicalPath.end()) {
+        known = files[static_cast<size_t>(existing->second)].get();
+        bool unchanged = !trackChanges || (::stat(canonical.c_str(), &info) == 0 &&
+                                           static_cast<size_t>(info.st_size) == known->size &&
+                                           info.st_mtim.tv_sec == known->modified.tv_sec &&
+                                           info.st_mtim.tv_nsec == known->modified.tv_nsec);
+        if (unchanged) {
+            ++known->holds;
+            return existing->second;
+        }
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return InvalidFileID;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return InvalidFileID;
+    }
+
+    auto file = std::make_unique<File>();
+    file->path = path;
+    file->canonicalPath = canonical;
+    file->modified = info.st_mtim;
+    if (trackChanges) {
+        file->copy.resize(static_cast<size_t>(info.st_size));
+        size_t done = 0;
+        while (done < file->copy.size()) {
+            ssize_t got = ::read(fd, &file->copy[done], file->copy.size() - done);
+            if (got <= 0) break;
+            done += static_cast<size_t>(got);
+        }
+        file->copy.resize(done);
+        file->data = file->copy.data();
+        file->size = done;
+        // Only touched: keep the old ID, whose buffer may be in use anyway.
+        if (known && known->copy == file->copy) {
+            close(fd);
+            known->modified = info.st_mtim;
+            ++known->holds;
+            return existing->second;
+        }
+    } else if (info.st_size > 0) {
+        void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return InvalidFileID;
+        }
+        file->data = static_cast<const char*>(data);
+        file->size = static_cast<size_t>(info.st_size);
+        file->mapped = true;
+    }
+    close(fd);
+
+    if (known) {
+        known->superseded = true;
+        if (known->holds == 0) files[static_cast<size_t>(existing->second)].reset();
+    }
+    file->holds = 1;
+    FileID id = static_cast<FileID>(files.size());
+    files.push_back(std::move(file));
+    byCanonicalPath[std::move(canonical)] = id;
+    return id;
+}
+
+void SourceManager::release(FileID file) {
+    if (file == InvalidFileID) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<File>& known = files.at(static_cast<size_t>(file));
+    if (--known->holds == 0 && known->superseded) known.reset();
+}
+
+const SourceManager::File& SourceManager::get(FileID file) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::unique_ptr<File>& known = files.at(static_cast<size_t>(file));
+    if (!known) throw std::logic_error("use of a released source file");
+    return *known;
+}
+
+std::string_view SourceManager::buffer(FileID file) const {
+    const File& f = get(file);
+    return std::string_view(f.data, f.size);
+}
+
+const std::string& SourceManager::path(FileID file) const {
+    return get(file).path;
+}
+
+const std::string& SourceManager::canonicalPath(FileID file) const {
+    return get(file).canonicalPath;
+}
+
+std::string_view SourceManager::line(FileID file, int lineNumber) const {
+    const File& f = get(file);
+    std::call_once(f.linesBuilt, [&f] {
+        f.lineStarts.push_back(0);
+        const char* p = f.data;
+        const char* end = f.data + f.size;
+        while (const void* nl = std::memchr(p, '\n', static_cast<size_t>(end - p))) {
+            p = static_cast<const char*>(nl) + 1;
+            if (p < end) f.lineStarts.push_back(static_cast<size_t>(p - f.data));
+        }
+    });
+    if (lineNumber < 1 || lineNumber > static_cast<int>(f.lineStarts.size())) return {};
+    size_t start = f.lineStarts[lineNumber - 1];
+    size_t stop = static_cast<size_t>(lineNumber) < f.lineStarts.size() ? f.lineStarts[lineNumber] - 1 : f.size;
+    if (stop > start && f.data[stop - 1] == '\n') stop--;
+    return std::string_view(f.data + start, stop - start);
+}
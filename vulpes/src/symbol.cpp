@@ -0,0 +1,41 @@
+#include "symbol.hpp"
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolTable::SymbolTable() {
+    // Reserve index 0 of shard 0 so that NoSymbol names the empty string.
+    shards[0].names.emplace_back();
+}
+
+Symbol SymbolTable::intern(std::string_view text) {
+    if (text.empty()) return NoSymbol;
+    size_t shardIndex = std::hash<std::string_view>()(text) % ShardCount;
+    Shard& shard = shards[shardIndex];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.lookup.find(text);
+    if (found != shard.lookup.end()) return found->second;
+    Symbol symbol = static_cast<Symbol>(shard.names.size() * ShardCount + shardIndex);
+    const std::string& stored = shard.names.emplace_back(text);
+    shard.lookup.emplace(stored, symbol);
+    return symbol;
+}
+
+std::string_view SymbolTable::name(Symbol symbol) const {
+    const Shard& shard = shards[symbol % ShardCount];
+    size_t index = symbol / ShardCount;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (index >= shard.names.size()) return {};
+    return shard.names[index];
+}
+
+size_t SymbolTable::size() const {
+    size_t total = 0;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.names.size();
+    }
+    return total;
+}
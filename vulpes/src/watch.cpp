@@ -0,0 +1,144 @@
+#include "watch.hpp"
+#include "error_handler.hpp"
+#include "parser.hpp"
+
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <poll.h>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+// Directories are watched rather than files, since editors often save by
+// writing a new file and renaming it over the old one.
+class Watcher {
+public:
+    Watcher() : fd(::inotify_init1(IN_CLOEXEC)) {
+        if (fd < 0) throw std::runtime_error("could not start inotify");
+    }
+    ~Watcher() { ::close(fd); }
+
+    // Paths are canonicalized first: two spellings of one directory share a
+    // single inotify watch.
+    void watch(const std::string& file) {
+        char resolved[PATH_MAX];
+        std::string path = ::realpath(file.c_str(), resolved) ? resolved : file;
+        size_t slash = path.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : path.substr(0, slash == 0 ? 1 : slash);
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        files.insert({dir, name});
+        if (dirs.count(dir)) return;
+        int wd = ::inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd >= 0) {
+            dirs[dir] = wd;
+            byWatch[wd] = dir;
+        }
+    }
+
+    // Blocks until a watched file changes, then waits for the burst of
+    // events one save produces to settle.
+    void wait() {
+        bool changed = false;
+        int timeout = -1;
+        alignas(inotify_event) char buffer[16 * 1024];
+        for (;;) {
+            pollfd ready{fd, POLLIN, 0};
+            int n = ::poll(&ready, 1, timeout);
+            if (n == 0) break;
+            if (n < 0) continue;
+            ssize_t size = ::read(fd, buffer, sizeof buffer);
+            for (ssize_t offset = 0; offset < size;) {
+                auto* event = reinterpret_cast<inotify_event*>(buffer + offset);
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                auto dir = byWatch.find(event->wd);
+                if (dir != byWatch.end() && event->len > 0 && files.count({dir->second, event->name})) changed = true;
+            }
+            if (changed) timeout = 50;
+        }
+    }
+
+private:
+    int fd;
+    std::map<std::string, int> dirs;
+    std::map<int, std::string> byWatch;
+    std::set<std::pair<std::string, std::string>> files;
+};
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int runWatch(const CompileOptions& options) {
+    CompilerSession session(true, options.jobs, options.moduleCacheDir);
+    CodeGenerator generator(session.modules, session.pool.get());
+    generator.setFunctionCaching(true);
+    generator.setRootPath(options.input);
+    Watcher watcher;
+    watcher.watch(options.input);
+
+    std::string stem = options.input.substr(0, options.input.find_last_of('.'));
+    std::string llFile = stem + ".ll";
+    std::string objFile = stem + ".o";
+    FileID rootFile = InvalidFileID;
+    std::unique_ptr<ASTContext> context;
+    std::vector<Statement*> program;
+
+    for (;; watcher.wait()) {
+        auto start = std::chrono::steady_clock::now();
+        FileID file = session.sources.load(options.input);
+        if (file == InvalidFileID) {
+            std::cerr << "Error: could not open " << options.input << std::endl;
+            continue;
+        }
+        // The root file is only parsed again when it changed; modules are
+        // re-read by the session's cache on their own. Only the version the
+        // program was parsed from stays held.
+        if (file != rootFile) {
+            ErrorHandler handler(session.sources, file);
+            auto fresh = std::make_unique<ASTContext>();
+            auto parsed = parseSource(session.sources.buffer(file), handler, *fresh, session.pool.get());
+            if (handler.hasErrors()) {
+                handler.printErrors();
+                session.sources.release(file);
+                continue;
+            }
+            context = std::move(fresh);
+            program = std::move(parsed);
+            std::swap(rootFile, file);
+        }
+        session.sources.release(file);
+
+        std::string ir;
+        try {
+            ir = generator.generate(program);
+        } catch (const std::exception& ex) {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            continue;
+        }
+        for (const std::string& path : session.modules.loadedPaths()) watcher.watch(path);
+        std::ofstream(llFile, std::ios::binary | std::ios::trunc) << ir;
+        double frontend = millisecondsSince(start);
+        if (options.showLLVM) std::cout << ir << std::endl;
+
+        bool built = compileObject(llFile, objFile) && linkExecutable({objFile}, options.output);
+        std::cout << (built ? "Executable created: " + options.output : std::string("Compilation failed")) << " ("
+                  << generator.functionsEmitted() << " functions lowered, " << generator.functionsReused()
+                  << " reused; frontend " << static_cast<int>(frontend) << " ms, total "
+                  << static_cast<int>(millisecondsSince(start)) << " ms)" << std::endl;
+        if (built && options.runExec) {
+            std::string run = "./" + options.output;
+            std::system(run.c_str());
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#!/bin/sh
+# The same root file in two directories, each with its own include.vlp,
+# must not share a --cache entry. Usage: build_cache_dirs.sh <vulpes>
+set -e
+vulpes=$1
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+mkdir "$work/a" "$work/b"
+for dir in a b; do
+    cat > "$work/$dir/main.vlp" <<'VLP'
+mod("include.vlp")::m;
+fx main() {
+    print("{}", m.f(5, 7));
+}
+VLP
+done
+printf 'fx f(int : a, int : b) -> int {\n    return a + b;\n}\n' > "$work/a/include.vlp"
+printf 'fx f(int : a, int : b) -> int {\n    return a * b;\n}\n' > "$work/b/include.vlp"
+
+check() {
+    (cd "$work/$1" && "$vulpes" --cache "$work/cache" main.vlp -o prog >/dev/null)
+    got=$(cd "$work/$1" && ./prog || true) # main's return value is its exit status
+    if [ "$got" != "$2" ]; then
+        echo "$1/: expected $2, got $got" >&2
+        exit 1
+    fi
+}
+check a 12
+check b 35
+check a 12
+check b 35